@@ -22,6 +22,7 @@
 #include "HandleType.h"
 #include "Interface.h"
 #include "Location.h"
+#include "Phase.h"
 #include "Scope.h"
 #include "TypeDef.h"
 
@@ -88,69 +89,94 @@ bool AST::containsInterfaces() const {
 }
 
 status_t AST::postParse() {
+    ScopedPhase postParsePhase("postParse");
+
+    const auto runPass = [](const char* name, const std::function<status_t()>& pass) {
+        ScopedPhase phase(name);
+        return pass();
+    };
     status_t err;
 
     // lookupTypes is the first pass.
-    err = lookupTypes();
+    err = runPass("lookupTypes", [&] { return lookupTypes(); });
     if (err != OK) return err;
     // validateDefinedTypesUniqueNames is the first call
     // after lookup, as other errors could appear because
     // user meant different type than we assumed.
-    err = validateDefinedTypesUniqueNames();
+    err = runPass("validateDefinedTypesUniqueNames",
+                  [&] { return validateDefinedTypesUniqueNames(); });
     if (err != OK) return err;
     // topologicalReorder is before resolveInheritance, as we
     // need to have no cycle while getting parent class.
-    err = topologicalReorder();
+    err = runPass("topologicalReorder", [&] { return topologicalReorder(); });
     if (err != OK) return err;
-    err = resolveInheritance();
+
+    // All references are resolved and scopes are in their final order, so the types the
+    // remaining passes visit don't change anymore.
+    PassTypes types;
+    runPass("collectPassTypes", [&] {
+        types = collectPassTypes();
+        return OK;
+    });
+
+    err = runPass("resolveInheritance", [&] { return resolveInheritance(types); });
     if (err != OK) return err;
-    err = lookupLocalIdentifiers();
+    err = runPass("lookupLocalIdentifiers", [&] { return lookupLocalIdentifiers(types); });
     if (err != OK) return err;
     // checkAcyclicConstantExpressions is after resolveInheritance,
     // as resolveInheritance autofills enum values.
-    err = checkAcyclicConstantExpressions();
+    err = runPass("checkAcyclicConstantExpressions",
+                  [&] { return checkAcyclicConstantExpressions(types); });
     if (err != OK) return err;
-    err = evaluate();
+    err = runPass("evaluate", [&] { return evaluate(types); });
     if (err != OK) return err;
-    err = validate();
+    err = runPass("validate", [&] { return validate(types); });
     if (err != OK) return err;
-    err = checkForwardReferenceRestrictions();
+    err = runPass("checkForwardReferenceRestrictions",
+                  [&] { return checkForwardReferenceRestrictions(types); });
     if (err != OK) return err;
-    err = gatherReferencedTypes();
+    err = runPass("gatherReferencedTypes", [&] { return gatherReferencedTypes(types); });
     if (err != OK) return err;
 
     // Make future packages not to call passes
     // for processed types and expressions
     constantExpressionRecursivePass(
+        types,
         [](ConstantExpression* ce) {
             ce->setPostParseCompleted();
             return OK;
         },
         true /* processBeforeDependencies */);
+    for (Type* type : types) {
+        type->setPostParseCompleted();
+    }
+
+    return OK;
+}
+
+AST::PassTypes AST::collectPassTypes() {
+    PassTypes types;
     std::unordered_set<const Type*> visited;
     mRootScope.recursivePass(
-        [](Type* type) {
-            type->setPostParseCompleted();
+        [&](Type* type) {
+            types.push_back(type);
             return OK;
         },
         &visited);
-
-    return OK;
+    return types;
 }
 
 status_t AST::constantExpressionRecursivePass(
-    const std::function<status_t(ConstantExpression*)>& func, bool processBeforeDependencies) {
-    std::unordered_set<const Type*> visitedTypes;
+    const PassTypes& types, const std::function<status_t(ConstantExpression*)>& func,
+    bool processBeforeDependencies) {
     std::unordered_set<const ConstantExpression*> visitedCE;
-    return mRootScope.recursivePass(
-        [&](Type* type) -> status_t {
-            for (auto* ce : type->getConstantExpressions()) {
-                status_t err = ce->recursivePass(func, &visitedCE, processBeforeDependencies);
-                if (err != OK) return err;
-            }
-            return OK;
-        },
-        &visitedTypes);
+    for (Type* type : types) {
+        for (auto* ce : type->getConstantExpressions()) {
+            status_t err = ce->recursivePass(func, &visitedCE, processBeforeDependencies);
+            if (err != OK) return err;
+        }
+    }
+    return OK;
 }
 
 status_t AST::lookupTypes() {
@@ -179,50 +205,44 @@ status_t AST::lookupTypes() {
         &visited);
 }
 
-status_t AST::gatherReferencedTypes() {
-    std::unordered_set<const Type*> visited;
-    return mRootScope.recursivePass(
-        [&](Type* type) -> status_t {
-            for (auto* nextRef : type->getReferences()) {
-                const Type *targetType = nextRef->get();
-                if (targetType->isNamedType()) {
-                    mReferencedTypeNames.insert(
-                            static_cast<const NamedType *>(targetType)->fqName());
-                }
+status_t AST::gatherReferencedTypes(const PassTypes& types) {
+    for (const Type* type : types) {
+        for (auto* nextRef : type->getReferences()) {
+            const Type *targetType = nextRef->get();
+            if (targetType->isNamedType()) {
+                mReferencedTypeNames.insert(
+                        static_cast<const NamedType *>(targetType)->fqName());
             }
+        }
+    }
 
-            return OK;
-        },
-        &visited);
+    return OK;
 }
 
-status_t AST::lookupLocalIdentifiers() {
-    std::unordered_set<const Type*> visitedTypes;
+status_t AST::lookupLocalIdentifiers(const PassTypes& types) {
     std::unordered_set<const ConstantExpression*> visitedCE;
 
-    return mRootScope.recursivePass(
-        [&](Type* type) -> status_t {
-            Scope* scope = type->isScope() ? static_cast<Scope*>(type) : type->parent();
-
-            for (auto* ce : type->getConstantExpressions()) {
-                status_t err = ce->recursivePass(
-                    [&](ConstantExpression* ce) {
-                        for (auto* nextRef : ce->getReferences()) {
-                            if (nextRef->isResolved()) continue;
-
-                            LocalIdentifier* iden = lookupLocalIdentifier(*nextRef, scope);
-                            if (iden == nullptr) return UNKNOWN_ERROR;
-                            nextRef->set(iden);
-                        }
-                        return OK;
-                    },
-                    &visitedCE, true /* processBeforeDependencies */);
-                if (err != OK) return err;
-            }
+    for (Type* type : types) {
+        Scope* scope = type->isScope() ? static_cast<Scope*>(type) : type->parent();
+
+        for (auto* ce : type->getConstantExpressions()) {
+            status_t err = ce->recursivePass(
+                [&](ConstantExpression* ce) {
+                    for (auto* nextRef : ce->getReferences()) {
+                        if (nextRef->isResolved()) continue;
+
+                        LocalIdentifier* iden = lookupLocalIdentifier(*nextRef, scope);
+                        if (iden == nullptr) return UNKNOWN_ERROR;
+                        nextRef->set(iden);
+                    }
+                    return OK;
+                },
+                &visitedCE, true /* processBeforeDependencies */);
+            if (err != OK) return err;
+        }
+    }
 
-            return OK;
-        },
-        &visitedTypes);
+    return OK;
 }
 
 status_t AST::validateDefinedTypesUniqueNames() const {
@@ -238,13 +258,17 @@ status_t AST::validateDefinedTypesUniqueNames() const {
         &visited);
 }
 
-status_t AST::resolveInheritance() {
-    std::unordered_set<const Type*> visited;
-    return mRootScope.recursivePass(&Type::resolveInheritance, &visited);
+status_t AST::resolveInheritance(const PassTypes& types) {
+    for (Type* type : types) {
+        status_t err = type->resolveInheritance();
+        if (err != OK) return err;
+    }
+    return OK;
 }
 
-status_t AST::evaluate() {
+status_t AST::evaluate(const PassTypes& types) {
     return constantExpressionRecursivePass(
+        types,
         [](ConstantExpression* ce) {
             ce->evaluate();
             return OK;
@@ -252,9 +276,12 @@ status_t AST::evaluate() {
         false /* processBeforeDependencies */);
 }
 
-status_t AST::validate() const {
-    std::unordered_set<const Type*> visited;
-    return mRootScope.recursivePass(&Type::validate, &visited);
+status_t AST::validate(const PassTypes& types) const {
+    for (const Type* type : types) {
+        status_t err = type->validate();
+        if (err != OK) return err;
+    }
+    return OK;
 }
 
 status_t AST::topologicalReorder() {
@@ -275,33 +302,27 @@ status_t AST::topologicalReorder() {
     return OK;
 }
 
-status_t AST::checkAcyclicConstantExpressions() const {
-    std::unordered_set<const Type*> visitedTypes;
+status_t AST::checkAcyclicConstantExpressions(const PassTypes& types) const {
     std::unordered_set<const ConstantExpression*> visitedCE;
     std::unordered_set<const ConstantExpression*> stack;
-    return mRootScope.recursivePass(
-        [&](const Type* type) -> status_t {
-            for (auto* ce : type->getConstantExpressions()) {
-                status_t err = ce->checkAcyclic(&visitedCE, &stack).status;
-                CHECK(err != OK || stack.empty());
-                if (err != OK) return err;
-            }
-            return OK;
-        },
-        &visitedTypes);
+    for (const Type* type : types) {
+        for (auto* ce : type->getConstantExpressions()) {
+            status_t err = ce->checkAcyclic(&visitedCE, &stack).status;
+            CHECK(err != OK || stack.empty());
+            if (err != OK) return err;
+        }
+    }
+    return OK;
 }
 
-status_t AST::checkForwardReferenceRestrictions() const {
-    std::unordered_set<const Type*> visited;
-    return mRootScope.recursivePass(
-        [](const Type* type) -> status_t {
-            for (const Reference<Type>* ref : type->getReferences()) {
-                status_t err = type->checkForwardReferenceRestrictions(*ref);
-                if (err != OK) return err;
-            }
-            return OK;
-        },
-        &visited);
+status_t AST::checkForwardReferenceRestrictions(const PassTypes& types) const {
+    for (const Type* type : types) {
+        for (const Reference<Type>* ref : type->getReferences()) {
+            status_t err = type->checkForwardReferenceRestrictions(*ref);
+            if (err != OK) return err;
+        }
+    }
+    return OK;
 }
 
 bool AST::addImport(const char *import) {
@@ -419,7 +440,22 @@ FQName AST::makeFullName(const char* localName, Scope* scope) const {
 
 void AST::addScopedType(NamedType* type, Scope* scope) {
     scope->addType(type);
-    mDefinedTypesByFullName[type->fqName()] = type;
+
+    const FQName& fqName = type->fqName();
+    mDefinedTypesByFullName[fqName] = type;
+
+    // Same boundaries as FQName::endsWith.
+    const std::string name = fqName.string();
+    for (size_t pos = 0; pos < name.size(); pos++) {
+        if (pos != 0 && name[pos - 1] != '.' && name[pos - 1] != ':' && name[pos] != '@') {
+            continue;
+        }
+
+        auto inserted = mDefinedTypesBySuffix.emplace(name.substr(pos), fqName);
+        if (!inserted.second && fqName < inserted.first->second) {
+            inserted.first->second = fqName;
+        }
+    }
 }
 
 LocalIdentifier* AST::lookupLocalIdentifier(const Reference<LocalIdentifier>& ref, Scope* scope) {
@@ -682,17 +718,13 @@ void AST::addToImportedNamesGranular(const FQName &fqName) {
 }
 
 Type *AST::findDefinedType(const FQName &fqName, FQName *matchingName) const {
-    for (const auto &pair : mDefinedTypesByFullName) {
-        const FQName &key = pair.first;
-        Type* type = pair.second;
-
-        if (key.endsWith(fqName)) {
-            *matchingName = key;
-            return type;
-        }
+    auto it = mDefinedTypesBySuffix.find(fqName.string());
+    if (it == mDefinedTypesBySuffix.end()) {
+        return nullptr;
     }
 
-    return nullptr;
+    *matchingName = it->second;
+    return mDefinedTypesByFullName.at(it->second);
 }
 
 void AST::getImportedPackages(std::set<FQName> *importSet) const {
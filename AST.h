@@ -25,8 +25,10 @@
 #include <map>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "Arena.h"
 #include "Scope.h"
 #include "Type.h"
 
@@ -81,15 +83,23 @@ struct AST {
     // being ready to generate output.
     status_t postParse();
 
+    // The passes following topologicalReorder run over a list of types collected once, in
+    // the order of a recursive pass from the root scope: those of this AST and those it
+    // references which aren't post-parsed yet. Types of imported ASTs which are already
+    // post-parsed are never visited.
+    using PassTypes = std::vector<Type*>;
+    PassTypes collectPassTypes();
+
     // Recursive pass on constant expression tree
     status_t constantExpressionRecursivePass(
-        const std::function<status_t(ConstantExpression*)>& func, bool processBeforeDependencies);
+        const PassTypes& types, const std::function<status_t(ConstantExpression*)>& func,
+        bool processBeforeDependencies);
 
     // Recursive tree pass that looks up all referenced types
     status_t lookupTypes();
 
     // Recursive tree pass that looks up all referenced local identifiers
-    status_t lookupLocalIdentifiers();
+    status_t lookupLocalIdentifiers(const PassTypes& types);
 
     // Recursive tree pass that validates that all defined types
     // have unique names in their scopes.
@@ -97,14 +107,14 @@ struct AST {
 
     // Recursive tree pass that completes type declarations
     // that depend on super types
-    status_t resolveInheritance();
+    status_t resolveInheritance(const PassTypes& types);
 
     // Recursive tree pass that evaluates constant expressions
-    status_t evaluate();
+    status_t evaluate(const PassTypes& types);
 
     // Recursive tree pass that validates all type-related
     // syntax restrictions
-    status_t validate() const;
+    status_t validate(const PassTypes& types) const;
 
     // Recursive tree pass that ensures that type definitions and references
     // are acyclic and reorderes type definitions in reversed topological order.
@@ -112,12 +122,12 @@ struct AST {
 
     // Recursive tree pass that ensures that constant expressions
     // are acyclic.
-    status_t checkAcyclicConstantExpressions() const;
+    status_t checkAcyclicConstantExpressions(const PassTypes& types) const;
 
     // Recursive tree pass that checks C++ forward declaration restrictions.
-    status_t checkForwardReferenceRestrictions() const;
+    status_t checkForwardReferenceRestrictions(const PassTypes& types) const;
 
-    status_t gatherReferencedTypes();
+    status_t gatherReferencedTypes(const PassTypes& types);
 
     void generateCppSource(Formatter& out) const;
 
@@ -127,6 +137,14 @@ struct AST {
     void generateProxyHeader(Formatter& out) const;
     void generatePassthroughHeader(Formatter& out) const;
 
+    // Split headers for types.hal (-Lc++-headers-split). types/<Type>.h and types/hw<Type>.h
+    // declare a single top-level type and only what it references, while types.h and
+    // hwtypes.h become umbrella headers which include all of them.
+    void generateTypeHeader(Formatter& out, const std::string& limitToType) const;
+    void generateHwTypeHeader(Formatter& out, const std::string& limitToType) const;
+    void generateTypesUmbrellaHeader(Formatter& out) const;
+    void generateHwTypesUmbrellaHeader(Formatter& out) const;
+
     void generateCppImplHeader(Formatter& out) const;
     void generateCppImplSource(Formatter& out) const;
 
@@ -188,7 +206,23 @@ struct AST {
 
     void addToImportedNamesGranular(const FQName &fqName);
 
+    // used by the parser and lexer, for nodes which live as long as this AST.
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return mArena.make<T>(std::forward<Args>(args)...);
+    }
+    template <typename T>
+    T* adopt(T* node) {
+        return mArena.adopt(node);
+    }
+    const char* intern(std::string_view str) { return mArena.intern(str); }
+
+    const Arena& arena() const { return mArena; }
+
    private:
+    // First, so that nodes outlive everything else referring to them.
+    Arena mArena;
+
     const Coordinator* mCoordinator;
     const Hash* mFileHash;
 
@@ -220,6 +254,11 @@ struct AST {
     // Types keyed by full names defined in this AST.
     std::map<FQName, Type *> mDefinedTypesByFullName;
 
+    // Every suffix of a key of mDefinedTypesByFullName which FQName::endsWith matches (e.g.
+    // "baz", "bar.baz", "IFoo.bar.baz" and "@1.0::IFoo.bar.baz" for
+    // "android.hardware.foo@1.0::IFoo.bar.baz"), mapped to the smallest key ending with it.
+    std::unordered_map<std::string, FQName> mDefinedTypesBySuffix;
+
     // used by the parser.
     size_t mSyntaxErrors = 0;
 
@@ -270,6 +309,10 @@ struct AST {
     void generateFetchSymbol(Formatter &out, const std::string &ifaceName) const;
 
     void generateProxySource(Formatter& out, const FQName& fqName) const;
+    // Whether predicate holds for any of the methods generateProxySource emits a body for.
+    bool anyProxyMethod(bool (*predicate)(const Method*)) const;
+    // Whether the proxy starts the threadpool before some call (see generateProxySource).
+    bool proxyStartsThreadPool() const;
 
     void generateStubSource(Formatter& out, const Interface* iface) const;
 
@@ -282,6 +325,14 @@ struct AST {
 
     void generateInterfaceSource(Formatter& out) const;
 
+    // Whether the proxy and stub count the calls of the user-defined methods (see -S).
+    bool hasMethodStats() const;
+    void generateMethodStats(Formatter& out) const;
+    // Declares _hidl_stats, which records the call in the given table of generateMethodStats
+    // when it goes out of scope. Whether the call failed is read from result at that point.
+    void generateMethodStatsScope(Formatter& out, const std::string& table, const Method* method,
+                                  const std::string& result) const;
+
     enum InstrumentationEvent {
         SERVER_API_ENTRY = 0,
         SERVER_API_EXIT,
@@ -312,15 +363,42 @@ struct AST {
                              const NamedReference<Type>* arg, bool isReader, Type::ErrorMode mode,
                              bool addPrefixToName) const;
 
+    // emitCppReaderWriter for each of args, in order. Consecutive scalar arguments are read or
+    // written together (see ScalarType::emitPackedReaderWriter).
+    void emitCppReaderWriters(Formatter& out, const std::string& parcelObj,
+                              bool parcelObjIsPointer,
+                              const std::vector<NamedReference<Type>*>& args, bool isReader,
+                              Type::ErrorMode mode, bool addPrefixToName) const;
+
     void emitCppResolveReferences(Formatter& out, const std::string& parcelObj,
                                   bool parcelObjIsPointer, const NamedReference<Type>* arg,
                                   bool isReader, Type::ErrorMode mode, bool addPrefixToName) const;
 
+    // Marshals args with emitCppReaderWriters, then emits the reference-resolving pass only for
+    // those args whose type needsResolveReferences().
+    void emitCppMarshalArgs(Formatter& out, const std::string& parcelObj,
+                            bool parcelObjIsPointer, const std::vector<NamedReference<Type>*>& args,
+                            bool isReader, Type::ErrorMode mode, bool addPrefixToName) const;
+
     void emitJavaReaderWriter(Formatter& out, const std::string& parcelObj,
                               const NamedReference<Type>* arg, bool isReader,
                               bool addPrefixToName) const;
 
     void emitTypeDeclarations(Formatter& out) const;
+
+    // Emits type.emitPackageTypeDeclarations, or only declares toString() when it is defined
+    // in the source file instead (Coordinator::isOutOfLineToString).
+    void emitPackageTypeDeclarations(Formatter& out, const Type& type) const;
+
+    const NamedType* findRootType(const std::string& localName) const;
+
+    // Top-level types of this file needed to declare roots, in declaration order, and the
+    // headers of the other files they reference.
+    std::vector<const NamedType*> getSplitHeaderTypes(const std::vector<const NamedType*>& roots,
+                                                      std::set<FQName>* includes) const;
+    void emitSplitHeaderTypes(Formatter& out, const std::vector<const NamedType*>& types,
+                              const std::set<FQName>& includes) const;
+
     void emitJavaTypeDeclarations(Formatter& out) const;
     void emitVtsTypeDeclarations(Formatter& out) const;
 
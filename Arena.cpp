@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Arena.h"
+
+#include <android-base/logging.h>
+#include <stdint.h>
+#include <string.h>
+#include <cstddef>
+
+namespace android {
+
+Arena::~Arena() {
+    for (auto it = mDestructors.rbegin(); it != mDestructors.rend(); ++it) {
+        it->destroy(it->object);
+    }
+}
+
+const char* Arena::intern(std::string_view str) {
+    auto it = mStrings.find(str);
+    if (it != mStrings.end()) return it->data();
+
+    char* copy = static_cast<char*>(allocate(str.size() + 1, 1));
+    memcpy(copy, str.data(), str.size());
+    copy[str.size()] = '\0';
+    mStrings.insert(std::string_view(copy, str.size()));
+    return copy;
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    // blocks are allocated with new[], so they are only aligned this much
+    CHECK(alignment <= alignof(std::max_align_t));
+
+    const uintptr_t next = reinterpret_cast<uintptr_t>(mNext);
+    const size_t padding = (alignment - next % alignment) % alignment;
+    if (mNext != nullptr && padding + size <= static_cast<size_t>(mEnd - mNext)) {
+        void* ret = mNext + padding;
+        mNext += padding + size;
+        return ret;
+    }
+
+    // Large objects get a block of their own, so that the current one isn't wasted.
+    if (size > kBlockSize / 4) {
+        mBlocks.emplace_back(new char[size]);
+        mBytesReserved += size;
+        return mBlocks.back().get();
+    }
+
+    mBlocks.emplace_back(new char[kBlockSize]);
+    mBytesReserved += kBlockSize;
+    mNext = mBlocks.back().get() + size;
+    mEnd = mBlocks.back().get() + kBlockSize;
+    return mBlocks.back().get();
+}
+
+}  // namespace android
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ARENA_H_
+
+#define ARENA_H_
+
+#include <android-base/macros.h>
+#include <stddef.h>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace android {
+
+// Owns the nodes of an AST. They are carved out of large blocks instead of
+// being allocated one by one, and all of them are destroyed, in reverse order
+// of creation, along with the arena. Strings are interned, so that every
+// occurrence of an identifier shares one copy.
+struct Arena {
+    Arena() = default;
+    ~Arena();
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            mDestructors.push_back({object, [](void* p) { static_cast<T*>(p)->~T(); }});
+        }
+        mObjects++;
+        return object;
+    }
+
+    // Takes ownership of an object allocated with new. Returns object.
+    template <typename T>
+    T* adopt(T* object) {
+        if (object != nullptr) {
+            mDestructors.push_back({object, [](void* p) { delete static_cast<T*>(p); }});
+            mObjects++;
+        }
+        return object;
+    }
+
+    // Returns a copy of str which lives as long as the arena.
+    const char* intern(std::string_view str);
+
+    size_t objects() const { return mObjects; }
+    size_t strings() const { return mStrings.size(); }
+    // Bytes taken by all blocks, including what isn't used yet.
+    size_t bytesReserved() const { return mBytesReserved; }
+
+   private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    struct Destructor {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    void* allocate(size_t size, size_t alignment);
+
+    std::vector<std::unique_ptr<char[]>> mBlocks;
+    char* mNext = nullptr;
+    char* mEnd = nullptr;
+    size_t mBytesReserved = 0;
+
+    std::vector<Destructor> mDestructors;
+    size_t mObjects = 0;
+
+    // views of strings stored in the blocks, each followed by a '\0'
+    std::unordered_set<std::string_view> mStrings;
+
+    DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+}  // namespace android
+
+#endif  // ARENA_H_
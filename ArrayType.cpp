@@ -605,6 +605,10 @@ void ArrayType::getAlignmentAndSize(size_t *align, size_t *size) const {
     }
 }
 
+size_t ArrayType::getEmbeddedParcelObjectCount() const {
+    return dimension() * mElementType->getEmbeddedParcelObjectCount();
+}
+
 size_t ArrayType::dimension() const {
     size_t numArrayElements = 1;
     for (auto size : mSizes) {
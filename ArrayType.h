@@ -136,6 +136,7 @@ struct ArrayType : public Type {
     bool deepContainsPointer(std::unordered_set<const Type*>* visited) const override;
 
     void getAlignmentAndSize(size_t *align, size_t *size) const override;
+    size_t getEmbeddedParcelObjectCount() const override;
 
    private:
     Reference<Type> mElementType;
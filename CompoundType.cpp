@@ -484,6 +484,19 @@ void CompoundType::emitPackageTypeDeclarations(Formatter& out) const {
         out << "os += \"}\"; return os;\n";
     }).endl().endl();
 
+    emitEqualityOperators(out);
+}
+
+void CompoundType::emitPackageTypeOutOfLineDeclarations(Formatter& out) const {
+    Scope::emitPackageTypeOutOfLineDeclarations(out);
+
+    out << "std::string toString(" << getCppArgumentType() << " o);\n";
+    out << "void appendToString(" << getCppArgumentType() << " o, std::string* os);\n\n";
+
+    emitEqualityOperators(out);
+}
+
+void CompoundType::emitEqualityOperators(Formatter& out) const {
     if (canCheckEquality()) {
         out << "static inline bool operator==("
             << getCppArgumentType() << " " << (mFields->empty() ? "/* lhs */" : "lhs") << ", "
@@ -563,6 +576,47 @@ void CompoundType::emitTypeDefinitions(Formatter& out, const std::string& prefix
     }
 }
 
+void CompoundType::emitToStringDefinitions(Formatter& out) const {
+    Scope::emitToStringDefinitions(out);
+
+    // Fields of this package are appended in place, the rest through their toString().
+    size_t reserve = 2;
+    out << "void appendToString(" << getCppArgumentType() << (mFields->empty() ? "" : " o")
+        << ", std::string* os) ";
+    out.block([&] {
+        // include toString for scalar types
+        out << "using ::android::hardware::toString;\n";
+        out << "os->append(\"{\");\n";
+
+        for (const NamedReference<Type>* field : *mFields) {
+            const std::string prefix =
+                    (field != *(mFields->begin()) ? ", ." : ".") + field->name() + " = ";
+            reserve += prefix.size() + 8;
+            out << "os->append(\"" << prefix << "\");\n";
+
+            const Type* type = field->get();
+            if ((type->isCompoundType() || type->isEnum()) &&
+                static_cast<const NamedType*>(type)->fqName().getPackageAndVersion() ==
+                        fqName().getPackageAndVersion()) {
+                out << fqName().cppNamespace() << "::appendToString(o." << field->name()
+                    << ", os);\n";
+            } else {
+                type->emitDump(out, "(*os)", "o." + field->name());
+            }
+        }
+
+        out << "os->append(\"}\");\n";
+    }).endl().endl();
+
+    out << "std::string toString(" << getCppArgumentType() << " o) ";
+    out.block([&] {
+        out << "std::string os;\n"
+            << "os.reserve(" << reserve << ");\n"
+            << "appendToString(o, &os);\n"
+            << "return os;\n";
+    }).endl().endl();
+}
+
 void CompoundType::emitJavaTypeDeclarations(Formatter& out, bool atTopLevel) const {
     out << "public final ";
 
@@ -1101,5 +1155,13 @@ void CompoundType::getAlignmentAndSize(size_t *align, size_t *size) const {
     }
 }
 
+size_t CompoundType::getEmbeddedParcelObjectCount() const {
+    size_t count = 0;
+    for (const auto* field : *mFields) {
+        count += field->type().getEmbeddedParcelObjectCount();
+    }
+    return count;
+}
+
 }  // namespace android
 
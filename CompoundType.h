@@ -120,9 +120,11 @@ struct CompoundType : public Scope {
     void emitTypeDeclarations(Formatter& out) const override;
     void emitTypeForwardDeclaration(Formatter& out) const override;
     void emitPackageTypeDeclarations(Formatter& out) const override;
+    void emitPackageTypeOutOfLineDeclarations(Formatter& out) const override;
     void emitPackageHwDeclarations(Formatter& out) const override;
 
     void emitTypeDefinitions(Formatter& out, const std::string& prefix) const override;
+    void emitToStringDefinitions(Formatter& out) const override;
 
     void emitJavaTypeDeclarations(Formatter& out, bool atTopLevel) const override;
 
@@ -137,6 +139,7 @@ struct CompoundType : public Scope {
     bool deepContainsPointer(std::unordered_set<const Type*>* visited) const override;
 
     void getAlignmentAndSize(size_t *align, size_t *size) const;
+    size_t getEmbeddedParcelObjectCount() const override;
 
     bool containsInterface() const;
 private:
@@ -146,6 +149,7 @@ private:
     void emitStructReaderWriter(
             Formatter &out, const std::string &prefix, bool isReader) const;
     void emitResolveReferenceDef(Formatter& out, const std::string& prefix, bool isReader) const;
+    void emitEqualityOperators(Formatter& out) const;
 
     DISALLOW_COPY_AND_ASSIGN(CompoundType);
 };
@@ -18,8 +18,10 @@
 
 #include <dirent.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <fstream>
 #include <iterator>
 
 #include <android-base/logging.h>
@@ -29,6 +31,7 @@
 
 #include "AST.h"
 #include "Interface.h"
+#include "Phase.h"
 #include "hidl-gen_l.h"
 
 static bool existdir(const char *name) {
@@ -42,6 +45,10 @@ static bool existdir(const char *name) {
 
 namespace android {
 
+// Must change whenever the rules in enforceRestrictionsOnPackage change, so that results
+// recorded by older versions of hidl-gen are ignored.
+static const std::string kEnforcementCacheHeader = "hidl-gen enforcement cache v1";
+
 const std::string &Coordinator::getRootPath() const {
     return mRootPath;
 }
@@ -66,6 +73,30 @@ bool Coordinator::isVerbose() const {
     return mVerbose;
 }
 
+void Coordinator::setOutOfLineToString(bool value) {
+    mOutOfLineToString = value;
+}
+
+bool Coordinator::isOutOfLineToString() const {
+    return mOutOfLineToString;
+}
+
+void Coordinator::setReuseParcels(bool value) {
+    mReuseParcels = value;
+}
+
+bool Coordinator::isReuseParcels() const {
+    return mReuseParcels;
+}
+
+void Coordinator::setMethodStats(bool value) {
+    mMethodStats = value;
+}
+
+bool Coordinator::isMethodStats() const {
+    return mMethodStats;
+}
+
 void Coordinator::setDepFile(const std::string& depFile) {
     mDepFile = depFile;
 }
@@ -77,6 +108,111 @@ void Coordinator::setOwner(const std::string& owner) {
     mOwner = owner;
 }
 
+void Coordinator::setCacheDir(const std::string& cacheDir) {
+    mCacheDir = cacheDir;
+
+    if (!mCacheDir.empty() && !StringHelper::EndsWith(mCacheDir, "/")) {
+        mCacheDir += "/";
+    }
+
+    Hash::setFileHashCache(mCacheDir.empty() ? "" : mCacheDir + "file-hashes");
+}
+
+void Coordinator::setResident(bool resident) {
+    mResident = resident;
+}
+
+void Coordinator::clearOptions() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+    mPackageRoots.clear();
+    mRootPath.clear();
+    mOutputPath.clear();
+    mDepFile.clear();
+    mVerbose = false;
+    mOwner.clear();
+    mOutOfLineToString = false;
+    mReuseParcels = false;
+    mMethodStats = false;
+    mCacheDir.clear();
+    Hash::setFileHashCache("");
+
+    mReadFiles.clear();
+    mReportedParses.clear();
+    mReportedEnforcements.clear();
+
+    mPackagesEnforcedHits = 0;
+    mHashCheckHits = 0;
+    mUnfrozenInterfacesHits = 0;
+}
+
+void Coordinator::dropStaleCaches() {
+    if (!mResident) return;
+
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+    // Parsing them again reports their errors again. Their ASTs stay in mFailedASTs.
+    for (auto it = mCache.begin(); it != mCache.end();) {
+        if (it->second == nullptr) {
+            mParseDependencies.erase(it->first);
+            it = mCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    const std::string configuration = getConfigurationKey();
+    bool stale = configuration != mResidentConfiguration;
+
+    // copied since checking a listing records it again
+    const Dependencies dependencies = mResidentDependencies;
+    for (auto it = dependencies.begin(); !stale && it != dependencies.end(); ++it) {
+        if (!isDependencyUnchanged(*it, true /* bypassHashCache */)) {
+            if (mVerbose) {
+                std::cerr << "VERBOSE: Dropping parsed files since " << *it << " changed."
+                          << std::endl;
+            }
+            stale = true;
+        }
+    }
+
+    if (!stale) return;
+
+    // ASTs refer to each other as well as to the hashes which are cleared, so all of them go.
+    for (const auto& pair : mCache) {
+        delete pair.second;
+    }
+    mCache.clear();
+    for (AST* ast : mFailedASTs) {
+        delete ast;
+    }
+    mFailedASTs.clear();
+    mPackagesEnforced.clear();
+    mParseDependencies.clear();
+    mEnforcementDependencies.clear();
+    mHashChecks.clear();
+    mUnfrozenInterfaces.clear();
+    mResidentDependencies.clear();
+    mReportedParses.clear();
+    mReportedEnforcements.clear();
+
+    Hash::clearCaches();
+    Interface::clearReservedMethods();
+
+    mResidentConfiguration = configuration;
+}
+
+void Coordinator::reportEnforcementCacheHits() const {
+    if (!mVerbose) return;
+
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+    fprintf(stderr,
+            "VERBOSE: enforcement cache hits: %zu packages, %zu hash checks, "
+            "%zu unfrozen interface lookups\n",
+            mPackagesEnforcedHits, mHashCheckHits, mUnfrozenInterfacesHits);
+}
+
 status_t Coordinator::addPackagePath(const std::string& root, const std::string& path, std::string* error) {
     FQName package = FQName(root, "0.0", "");
     for (const PackageRoot &packageRoot : mPackageRoots) {
@@ -118,14 +254,8 @@ Formatter Coordinator::getFormatter(const FQName& fqName, Location location,
         return Formatter::invalid();
     }
 
-    FILE* file = fopen(filepath.c_str(), "w");
-
-    if (file == nullptr) {
-        fprintf(stderr, "ERROR: could not open file %s: %d\n", filepath.c_str(), errno);
-        return Formatter::invalid();
-    }
-
-    return Formatter(file);
+    // Written when closed, and left alone if unchanged.
+    return Formatter(filepath);
 }
 
 status_t Coordinator::getFilepath(const FQName& fqName, Location location,
@@ -167,6 +297,8 @@ status_t Coordinator::getFilepath(const FQName& fqName, Location location,
 }
 
 void Coordinator::onFileAccess(const std::string& path, const std::string& mode) const {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
     if (mode == "r") {
         // This is a global list. It's not cleared when a second fqname is processed for
         // two reasons:
@@ -222,8 +354,14 @@ status_t Coordinator::parseOptional(const FQName& fqName, AST** ast, std::set<AS
                                     Enforce enforcement) const {
     CHECK(fqName.isFullyQualified());
 
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+    ScopedPhase phase("parseOptional");
+    if (ScopedPhase::isEnabled()) phase.addArg("fqName", fqName.string());
+
     auto it = mCache.find(fqName);
     if (it != mCache.end()) {
+        phase.addArg("cache", "hit");
         *ast = (*it).second;
 
         if (*ast != nullptr && parsedASTs != nullptr) {
@@ -235,12 +373,35 @@ status_t Coordinator::parseOptional(const FQName& fqName, AST** ast, std::set<AS
             return UNKNOWN_ERROR;
         }
 
+        auto dependencies = mParseDependencies.find(fqName);
+        if (dependencies != mParseDependencies.end()) {
+            recordDependencies(dependencies->second);
+        }
+
+        // It may have been parsed by an earlier invocation, with a different depfile and
+        // enforcement. This invocation would have parsed it here, so do what that would have.
+        if (mResident && mReportedParses.insert(fqName).second) {
+            if (dependencies != mParseDependencies.end()) {
+                reportFileAccesses(dependencies->second);
+            }
+
+            status_t err = enforceRestrictionsOnPackage(fqName, enforcement);
+            if (err != OK) {
+                *ast = nullptr;
+                return err;
+            }
+        }
+
         return OK;
     }
 
+    phase.addArg("cache", "miss");
+
     // Add this to the cache immediately, so we can discover circular imports.
     mCache[fqName] = nullptr;
 
+    DependencyRecorder recorder(this);
+
     AST *typesAST = nullptr;
 
     if (fqName.name() != "types") {
@@ -260,6 +421,15 @@ status_t Coordinator::parseOptional(const FQName& fqName, AST** ast, std::set<AS
 
     const std::string path = makeAbsolute(packagePath + fqName.name() + ".hal");
 
+    // read once for both hashing and parsing
+    std::string source;
+    if (!Hash::readFile(path, &source)) {
+        mCache.erase(fqName);  // nullptr in cache is used to find circular imports
+        *ast = nullptr;
+        recordDependency("missing " + path);
+        return OK;  // File does not exist, nullptr AST* == file doesn't exist.
+    }
+
     *ast = new AST(this, &Hash::getHash(path));
 
     if (typesAST != NULL) {
@@ -268,20 +438,16 @@ status_t Coordinator::parseOptional(const FQName& fqName, AST** ast, std::set<AS
         (*ast)->addImportedAST(typesAST);
     }
 
-    std::unique_ptr<FILE, std::function<void(FILE*)>> file(fopen(path.c_str(), "rb"), fclose);
-
-    if (file == nullptr) {
-        mCache.erase(fqName);  // nullptr in cache is used to find circular imports
-        delete *ast;
-        *ast = nullptr;
-        return OK;  // File does not exist, nullptr AST* == file doesn't exist.
-    }
-
     onFileAccess(path, "r");
+    recordDependency("file " + (*ast)->getFileHash()->contentHexString() + " " + path);
 
-    // parse file takes ownership of file
-    if (parseFile(*ast, std::move(file)) != OK || (*ast)->postParse() != OK) {
-        delete *ast;
+    status_t parseErr;
+    {
+        ScopedPhase phase("parseFile");
+        parseErr = parseFile(*ast, std::move(source));
+    }
+    if (parseErr != OK || (*ast)->postParse() != OK) {
+        mFailedASTs.push_back(*ast);
         *ast = nullptr;
         return UNKNOWN_ERROR;
     }
@@ -331,7 +497,7 @@ status_t Coordinator::parseOptional(const FQName& fqName, AST** ast, std::set<AS
     }
 
     if (err != OK) {
-        delete *ast;
+        mFailedASTs.push_back(*ast);
         *ast = nullptr;
         return err;
     }
@@ -343,16 +509,39 @@ status_t Coordinator::parseOptional(const FQName& fqName, AST** ast, std::set<AS
     // put it into the cache now, so that enforceRestrictionsOnPackage can
     // parse fqName.
     mCache[fqName] = *ast;
+    ScopedPhase::count("ASTs parsed", 1);
+    ScopedPhase::count("AST arena bytes", (*ast)->arena().bytesReserved());
+
+    if (mVerbose) {
+        const Arena& arena = (*ast)->arena();
+        fprintf(stderr, "VERBOSE: parsed %s: %zu nodes, %zu strings, %zu KiB\n",
+                fqName.string().c_str(), arena.objects(), arena.strings(),
+                arena.bytesReserved() / 1024);
+    }
+
+    // Enforcement parses fqName again, which hits the cache. Make that replay the file itself,
+    // so that the enforcement results depend on it.
+    if (isTrackingDependencies()) {
+        mParseDependencies[fqName] = recorder.dependencies();
+    }
+    if (mResident) {
+        mReportedParses.insert(fqName);
+    }
 
     // For each .hal file that hidl-gen parses, the whole package will be checked.
     err = enforceRestrictionsOnPackage(fqName, enforcement);
     if (err != OK) {
+        mParseDependencies.erase(fqName);
         mCache[fqName] = nullptr;
-        delete *ast;
+        mFailedASTs.push_back(*ast);
         *ast = nullptr;
         return err;
     }
 
+    if (isTrackingDependencies()) {
+        mParseDependencies[fqName] = recorder.dependencies();
+    }
+
     return OK;
 }
 
@@ -501,6 +690,9 @@ status_t Coordinator::getPackageInterfaceFiles(
                   return lhs < rhs;
               });
 
+    recordDependency("listing " + StringHelper::JoinStrings(*fileNames, ",") + " " +
+                     package.getPackageAndVersion().string());
+
     return OK;
 }
 
@@ -633,21 +825,52 @@ status_t Coordinator::enforceRestrictionsOnPackage(const FQName& fqName,
         return OK;
     }
 
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
     FQName package = fqName.getPackageAndVersion();
+
+    ScopedPhase phase("enforceRestrictionsOnPackage");
+    if (ScopedPhase::isEnabled()) phase.addArg("package", package.string());
+
+    const EnforcedPackage key(package, enforcement);
+
     // look up cache.
-    if (mPackagesEnforced.find(package) != mPackagesEnforced.end()) {
+    if (mPackagesEnforced.find(key) != mPackagesEnforced.end()) {
+        phase.addArg("cache", "hit");
+        mPackagesEnforcedHits++;
+        auto dependencies = mEnforcementDependencies.find(key);
+        if (dependencies != mEnforcementDependencies.end()) {
+            recordDependencies(dependencies->second);
+
+            if (mResident && mReportedEnforcements.insert(key).second) {
+                reportFileAccesses(dependencies->second);
+            }
+        }
         return OK;
     }
 
+    // look up results of previous invocations.
+    if (loadEnforcementCache(package, enforcement)) {
+        phase.addArg("cache", "disk");
+        return OK;
+    }
+    phase.addArg("cache", "miss");
+
+    DependencyRecorder recorder(this);
+
     // enforce all rules.
     status_t err;
 
-    err = enforceMinorVersionUprevs(package, enforcement);
+    {
+        ScopedPhase phase("enforceMinorVersionUprevs");
+        err = enforceMinorVersionUprevs(package, enforcement);
+    }
     if (err != OK) {
         return err;
     }
 
     if (enforcement != Enforce::NO_HASH) {
+        ScopedPhase phase("enforceHashes");
         err = enforceHashes(package);
         if (err != OK) {
             return err;
@@ -655,7 +878,18 @@ status_t Coordinator::enforceRestrictionsOnPackage(const FQName& fqName,
     }
 
     // cache it so that it won't need to be enforced again.
-    mPackagesEnforced.insert(package);
+    mPackagesEnforced.insert(key);
+
+    if (isTrackingDependencies()) {
+        mEnforcementDependencies[key] = recorder.dependencies();
+    }
+    if (!mCacheDir.empty()) {
+        writeEnforcementCache(package, enforcement, recorder.dependencies());
+    }
+    if (mResident) {
+        mReportedEnforcements.insert(key);
+    }
+
     return OK;
 }
 
@@ -681,7 +915,12 @@ status_t Coordinator::enforceMinorVersionUprevs(const FQName& currentPackage,
                                       &prevPackagePath);
         if (err != OK) return err;
 
-        if (existdir(makeAbsolute(prevPackagePath).c_str())) {
+        const std::string absolutePrevPackagePath = makeAbsolute(prevPackagePath);
+        bool prevPackageExists = existdir(absolutePrevPackagePath.c_str());
+        recordDependency(std::string("dir ") + (prevPackageExists ? "1 " : "0 ") +
+                         absolutePrevPackagePath);
+
+        if (prevPackageExists) {
             hasPrevPackage = true;
             break;
         }
@@ -798,6 +1037,20 @@ status_t Coordinator::enforceMinorVersionUprevs(const FQName& currentPackage,
 }
 
 Coordinator::HashStatus Coordinator::checkHash(const FQName& fqName) const {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+    // Packages commonly import the same packages, so the same interfaces are checked again
+    // and again.
+    auto it = mHashChecks.find(fqName);
+    if (it != mHashChecks.end()) {
+        mHashCheckHits++;
+        if (it->second.hashFileExists) onFileAccess(it->second.hashPath, "r");
+        recordDependencies(it->second.dependencies);
+        return it->second.status;
+    }
+
+    DependencyRecorder recorder(this);
+
     AST* ast = parse(fqName);
     if (ast == nullptr) return HashStatus::ERROR;
 
@@ -811,6 +1064,11 @@ Coordinator::HashStatus Coordinator::checkHash(const FQName& fqName) const {
     std::vector<std::string> frozen =
         Hash::lookupHash(hashPath, fqName.string(), &error, &fileExists);
     if (fileExists) onFileAccess(hashPath, "r");
+    if (isTrackingDependencies()) {
+        recordDependency(fileExists ? "file " + Hash::getHash(hashPath).contentHexString() + " " +
+                                          hashPath
+                                    : "missing " + hashPath);
+    }
 
     if (error.size() > 0) {
         std::cerr << "ERROR: " << error << std::endl;
@@ -821,7 +1079,10 @@ Coordinator::HashStatus Coordinator::checkHash(const FQName& fqName) const {
     if (frozen.size() == 0) {
         // This ensures that it can be detected.
         Hash::clearHash(ast->getFilename());
+        recordDependency("unfrozen " + ast->getFilename());
 
+        mHashChecks[fqName] = {HashStatus::UNFROZEN, hashPath, fileExists,
+                               recorder.dependencies()};
         return HashStatus::UNFROZEN;
     }
 
@@ -834,6 +1095,7 @@ Coordinator::HashStatus Coordinator::checkHash(const FQName& fqName) const {
         return HashStatus::CHANGED;
     }
 
+    mHashChecks[fqName] = {HashStatus::FROZEN, hashPath, fileExists, recorder.dependencies()};
     return HashStatus::FROZEN;
 }
 
@@ -850,21 +1112,47 @@ status_t Coordinator::getUnfrozenDependencies(const FQName& fqName,
     // no circular dependency is already guaranteed by parsing
     // indirect dependencies will be checked when the imported interface frozen checks are done
     for (const FQName& importedPackage : imported) {
-        std::vector<FQName> packageInterfaces;
-        status_t err = appendPackageInterfacesToVector(importedPackage, &packageInterfaces);
+        status_t err = getUnfrozenInterfaces(importedPackage, result);
         if (err != OK) {
             return err;
         }
+    }
 
-        for (const FQName& importedName : packageInterfaces) {
-            HashStatus status = checkHash(importedName);
-            if (status == HashStatus::ERROR) return UNKNOWN_ERROR;
-            if (status == HashStatus::UNFROZEN) {
-                result->insert(importedName);
-            }
+    return OK;
+}
+
+status_t Coordinator::getUnfrozenInterfaces(const FQName& package,
+                                            std::set<FQName>* result) const {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+    auto it = mUnfrozenInterfaces.find(package);
+    if (it != mUnfrozenInterfaces.end()) {
+        mUnfrozenInterfacesHits++;
+        recordDependencies(it->second.dependencies);
+        result->insert(it->second.interfaces.begin(), it->second.interfaces.end());
+        return OK;
+    }
+
+    DependencyRecorder recorder(this);
+
+    std::vector<FQName> packageInterfaces;
+    status_t err = appendPackageInterfacesToVector(package, &packageInterfaces);
+    if (err != OK) {
+        return err;
+    }
+
+    std::set<FQName> unfrozen;
+    for (const FQName& name : packageInterfaces) {
+        HashStatus status = checkHash(name);
+        if (status == HashStatus::ERROR) return UNKNOWN_ERROR;
+        if (status == HashStatus::UNFROZEN) {
+            unfrozen.insert(name);
         }
     }
 
+    result->insert(unfrozen.begin(), unfrozen.end());
+    mUnfrozenInterfaces[package] = {std::move(unfrozen), recorder.dependencies()};
+
     return OK;
 }
 
@@ -903,6 +1191,215 @@ status_t Coordinator::enforceHashes(const FQName& currentPackage) const {
     return err;
 }
 
+Coordinator::DependencyRecorder::DependencyRecorder(const Coordinator* coordinator)
+    : mCoordinator(coordinator) {
+    mCoordinator->mDependencyRecorders.push_back(&mDependencies);
+}
+
+Coordinator::DependencyRecorder::~DependencyRecorder() {
+    CHECK(mCoordinator->mDependencyRecorders.back() == &mDependencies);
+    mCoordinator->mDependencyRecorders.pop_back();
+}
+
+bool Coordinator::isTrackingDependencies() const {
+    return !mCacheDir.empty() || mResident;
+}
+
+void Coordinator::recordDependency(const std::string& dependency) const {
+    if (!isTrackingDependencies()) return;
+
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+    for (Dependencies* recorder : mDependencyRecorders) {
+        recorder->insert(dependency);
+    }
+    if (mResident) {
+        mResidentDependencies.insert(dependency);
+    }
+}
+
+void Coordinator::recordDependencies(const Dependencies& dependencies) const {
+    if (!isTrackingDependencies()) return;
+
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+    for (Dependencies* recorder : mDependencyRecorders) {
+        recorder->insert(dependencies.begin(), dependencies.end());
+    }
+    if (mResident) {
+        mResidentDependencies.insert(dependencies.begin(), dependencies.end());
+    }
+}
+
+// Splits a line written by Coordinator::recordDependency into its parts. value is only
+// present for some kinds of dependencies.
+static bool splitDependency(const std::string& dependency, std::string* kind, std::string* value,
+                            std::string* path) {
+    size_t kindEnd = dependency.find(' ');
+    if (kindEnd == std::string::npos) return false;
+    *kind = dependency.substr(0, kindEnd);
+
+    if (*kind == "missing" || *kind == "unfrozen") {
+        value->clear();
+        *path = dependency.substr(kindEnd + 1);
+        return true;
+    }
+
+    if (*kind == "file" || *kind == "dir" || *kind == "listing") {
+        size_t valueEnd = dependency.find(' ', kindEnd + 1);
+        if (valueEnd == std::string::npos) return false;
+        *value = dependency.substr(kindEnd + 1, valueEnd - kindEnd - 1);
+        *path = dependency.substr(valueEnd + 1);
+        return true;
+    }
+
+    return false;
+}
+
+void Coordinator::reportFileAccesses(const Dependencies& dependencies) const {
+    for (const std::string& dependency : dependencies) {
+        std::string kind, value, path;
+        if (splitDependency(dependency, &kind, &value, &path) && kind == "file") {
+            onFileAccess(path, "r");
+        }
+    }
+}
+
+bool Coordinator::isDependencyUnchanged(const std::string& dependency,
+                                        bool bypassHashCache) const {
+    std::string kind, value, path;
+    if (!splitDependency(dependency, &kind, &value, &path)) return false;
+
+    if (kind == "file") {
+        if (access(path.c_str(), R_OK) != 0) return false;
+        return value == (bypassHashCache ? Hash::hexFileHash(path)
+                                         : Hash::getHash(path).contentHexString());
+    }
+    if (kind == "missing") {
+        return access(path.c_str(), F_OK) != 0;
+    }
+    if (kind == "dir") {
+        return existdir(path.c_str()) == (value == "1");
+    }
+    if (kind == "listing") {
+        FQName package;
+        if (!FQName::parse(path, &package)) return false;
+
+        // getPackageInterfaceFiles complains about missing packages
+        std::string packagePath;
+        if (getPackagePath(package, false /* relative */, false /* sanitized */, &packagePath) !=
+                OK ||
+            !existdir(makeAbsolute(packagePath).c_str())) {
+            return false;
+        }
+
+        std::vector<std::string> fileNames;
+        if (getPackageInterfaceFiles(package, &fileNames) != OK) return false;
+        return StringHelper::JoinStrings(fileNames, ",") == value;
+    }
+    if (kind == "unfrozen") {
+        return true;  // replayed, not checked
+    }
+
+    return false;
+}
+
+std::string Coordinator::getConfigurationKey() const {
+    std::string key = mRootPath;
+    for (const PackageRoot& packageRoot : mPackageRoots) {
+        key += " " + packageRoot.root.package() + ":" + packageRoot.path;
+    }
+    return key;
+}
+
+std::string Coordinator::getEnforcementCachePath(const FQName& package, Enforce enforcement,
+                                                 std::string* key) const {
+    // Results also depend on where packages are found, which isn't part of the dependencies.
+    *key = getConfigurationKey() + (enforcement == Enforce::NO_HASH ? " no-hash" : " full");
+
+    return mCacheDir + package.string() + "-" + std::to_string(std::hash<std::string>()(*key));
+}
+
+bool Coordinator::loadEnforcementCache(const FQName& package, Enforce enforcement) const {
+    if (mCacheDir.empty()) return false;
+
+    std::string key;
+    const std::string path = getEnforcementCachePath(package, enforcement, &key);
+
+    std::ifstream stream(path);
+    if (!stream) return false;
+
+    std::string line;
+    if (!std::getline(stream, line) || line != kEnforcementCacheHeader) return false;
+    if (!std::getline(stream, line) || line != "key " + key) return false;
+
+    Dependencies dependencies;
+    while (std::getline(stream, line)) {
+        if (!isDependencyUnchanged(line, false /* bypassHashCache */)) {
+            if (mVerbose) {
+                std::cerr << "VERBOSE: Enforcement cache for " << package.string()
+                          << " is out of date: " << line << std::endl;
+            }
+            return false;
+        }
+        dependencies.insert(line);
+    }
+
+    // Replay the side effects enforcement would have had.
+    for (const std::string& dependency : dependencies) {
+        std::string kind, value, dependencyPath;
+        splitDependency(dependency, &kind, &value, &dependencyPath);  // checked above
+
+        if (kind == "file") {
+            onFileAccess(dependencyPath, "r");
+        } else if (kind == "unfrozen") {
+            Hash::clearHash(dependencyPath);
+        }
+    }
+
+    recordDependencies(dependencies);
+    const EnforcedPackage enforced(package, enforcement);
+    mEnforcementDependencies[enforced] = dependencies;
+    mPackagesEnforced.insert(enforced);
+    if (mResident) {
+        mReportedEnforcements.insert(enforced);
+    }
+
+    if (mVerbose) {
+        std::cerr << "VERBOSE: Enforcement of " << package.string() << " loaded from " << path
+                  << std::endl;
+    }
+
+    return true;
+}
+
+void Coordinator::writeEnforcementCache(const FQName& package, Enforce enforcement,
+                                        const Dependencies& dependencies) const {
+    std::string key;
+    const std::string path = getEnforcementCachePath(package, enforcement, &key);
+
+    // Other hidl-gen processes may be reading this file, so it is replaced atomically.
+    const std::string tmpPath = path + "." + std::to_string(getpid());
+
+    if (!MakeParentHierarchy(path)) {
+        std::cerr << "WARNING: could not make directories for " << path << std::endl;
+        return;
+    }
+
+    std::ofstream stream(tmpPath);
+    stream << kEnforcementCacheHeader << "\n";
+    stream << "key " << key << "\n";
+    for (const std::string& dependency : dependencies) {
+        stream << dependency << "\n";
+    }
+    stream.close();
+
+    if (!stream || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "WARNING: could not write enforcement cache " << path << std::endl;
+        unlink(tmpPath.c_str());
+    }
+}
+
 bool Coordinator::MakeParentHierarchy(const std::string &path) {
     static const mode_t kMode = 0755;
 
@@ -918,7 +1415,8 @@ bool Coordinator::MakeParentHierarchy(const std::string &path) {
             }
 
             int res = mkdir(partial.c_str(), kMode);
-            if (res < 0) {
+            // another thread or process may have created it in the meantime
+            if (res < 0 && errno != EEXIST) {
                 return false;
             }
         } else if (!S_ISDIR(st.st_mode)) {
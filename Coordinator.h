@@ -23,6 +23,7 @@
 #include <hidl-util/Formatter.h>
 #include <utils/Errors.h>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
 #include <vector>
@@ -47,6 +48,42 @@ struct Coordinator {
     const std::string& getOwner() const;
     void setOwner(const std::string& owner);
 
+    // Whether toString() of structs, unions and enums is defined in the generated sources
+    // rather than inline in the headers. Headers and sources of a package must agree.
+    void setOutOfLineToString(bool value);
+    bool isOutOfLineToString() const;
+
+    // Whether generated C++ proxies of methods which only take scalars keep the data Parcel
+    // of each thread between calls, so that its buffer is reused instead of being allocated
+    // for every call.
+    void setReuseParcels(bool value);
+    bool isReuseParcels() const;
+
+    // Whether generated C++ proxies and stubs count the calls, errors and latencies of each
+    // method, for the default debug() to report.
+    void setMethodStats(bool value);
+    bool isMethodStats() const;
+
+    // Directory to persist enforceRestrictionsOnPackage results in across invocations.
+    // Caching is disabled if this is never set.
+    void setCacheDir(const std::string& cacheDir);
+
+    // Keeps parsed ASTs and enforcement results for reuse by later invocations in the same
+    // process. See clearOptions and dropStaleCaches.
+    void setResident(bool resident);
+
+    // Forgets all options, as well as files read, so that the coordinator can be reused for
+    // another invocation.
+    void clearOptions();
+
+    // If resident, drops all parsed ASTs and enforcement results in case package roots or
+    // any file they were computed from changed since, and files which failed to parse so that
+    // their errors are reported again. Must be called after setting options.
+    void dropStaleCaches();
+
+    // If verbose, reports how often enforcement results were reused during this invocation.
+    void reportEnforcementCacheHits() const;
+
     // adds path only if it doesn't exist
     status_t addPackagePath(const std::string& root, const std::string& path, std::string* error);
     // adds path if it hasn't already been added
@@ -143,6 +180,8 @@ private:
     };
     HashStatus checkHash(const FQName& fqName) const;
     status_t getUnfrozenDependencies(const FQName& fqName, std::set<FQName>* result) const;
+    // Adds the interfaces of package which aren't frozen to result.
+    status_t getUnfrozenInterfaces(const FQName& package, std::set<FQName>* result) const;
 
     // indicates that packages in "android.hardware" will be looked up in hardware/interfaces
     struct PackageRoot {
@@ -172,15 +211,107 @@ private:
     // hidl-gen options
     bool mVerbose = false;
     std::string mOwner;
+    bool mOutOfLineToString = false;
+    bool mReuseParcels = false;
+    bool mMethodStats = false;
+    std::string mCacheDir;
+    bool mResident = false;
+
+    // Guards everything below which is mutable, so that ASTs can be parsed and generated from
+    // on multiple threads. Recursive since parsing is.
+    mutable std::recursive_mutex mMutex;
 
     // cache to parse().
     mutable std::map<FQName, AST *> mCache;
 
-    // cache to enforceRestrictionsOnPackage().
-    mutable std::set<FQName> mPackagesEnforced;
+    // ASTs which failed after being parsed. Others parsed in the meantime (e.g. while
+    // enforcing) may refer to their nodes, so they are only deleted along with all of mCache.
+    mutable std::vector<AST*> mFailedASTs;
+
+    // cache to enforceRestrictionsOnPackage(). A package enforced without hashes still needs
+    // them checked when it is enforced in full, so results are kept per enforcement.
+    using EnforcedPackage = std::pair<FQName, Enforce>;
+    mutable std::set<EnforcedPackage> mPackagesEnforced;
 
     mutable std::set<std::string> mReadFiles;
 
+    // Everything the result of parsing or enforcing something depends on, as lines of an
+    // enforcement cache file (see recordDependency). Only tracked if mCacheDir is set.
+    using Dependencies = std::set<std::string>;
+
+    // Collects dependencies while in scope. Recorders nest, and a dependency is added to
+    // every recorder which is currently in scope.
+    struct DependencyRecorder {
+        DependencyRecorder(const Coordinator* coordinator);
+        ~DependencyRecorder();
+
+        const Dependencies& dependencies() const { return mDependencies; }
+
+       private:
+        const Coordinator* mCoordinator;
+        Dependencies mDependencies;
+
+        DISALLOW_COPY_AND_ASSIGN(DependencyRecorder);
+    };
+
+    mutable std::vector<Dependencies*> mDependencyRecorders;
+    mutable std::map<FQName, Dependencies> mParseDependencies;
+    mutable std::map<EnforcedPackage, Dependencies> mEnforcementDependencies;
+
+    // caches to checkHash() and getUnfrozenInterfaces(). Only successful results are kept,
+    // along with what they depend on.
+    struct HashCheck {
+        HashStatus status;
+        std::string hashPath;
+        // whether hashPath existed, and so was read, when the result was computed
+        bool hashFileExists;
+        Dependencies dependencies;
+    };
+    struct UnfrozenInterfaces {
+        std::set<FQName> interfaces;
+        Dependencies dependencies;
+    };
+    mutable std::map<FQName, HashCheck> mHashChecks;
+    mutable std::map<FQName, UnfrozenInterfaces> mUnfrozenInterfaces;
+
+    // Hits on the caches to enforceRestrictionsOnPackage(), checkHash() and
+    // getUnfrozenInterfaces() during the current invocation.
+    mutable size_t mPackagesEnforcedHits = 0;
+    mutable size_t mHashCheckHits = 0;
+    mutable size_t mUnfrozenInterfacesHits = 0;
+
+    // When resident, everything cached depends on these and on mResidentConfiguration.
+    mutable Dependencies mResidentDependencies;
+    std::string mResidentConfiguration;
+    // Cached ASTs and enforcement results whose files have been reported to onFileAccess
+    // during the current invocation.
+    mutable std::set<FQName> mReportedParses;
+    mutable std::set<EnforcedPackage> mReportedEnforcements;
+
+    bool isTrackingDependencies() const;
+
+    // dependency is one of:
+    //     file <content hash> <path>
+    //     missing <path>
+    //     dir <0 or 1, whether it exists> <path>
+    //     listing <comma separated .hal names> <package>
+    //     unfrozen <path whose hash was cleared>
+    void recordDependency(const std::string& dependency) const;
+    void recordDependencies(const Dependencies& dependencies) const;
+    void reportFileAccesses(const Dependencies& dependencies) const;
+    bool isDependencyUnchanged(const std::string& dependency, bool bypassHashCache) const;
+
+    // root path and package roots, which determine where files are found
+    std::string getConfigurationKey() const;
+
+    std::string getEnforcementCachePath(const FQName& package, Enforce enforcement,
+                                        std::string* key) const;
+    // Returns true if package was enforced already by a previous invocation, none of whose
+    // dependencies have changed since.
+    bool loadEnforcementCache(const FQName& package, Enforce enforcement) const;
+    void writeEnforcementCache(const FQName& package, Enforce enforcement,
+                               const Dependencies& dependencies) const;
+
     // Returns the given path if it is absolute, otherwise it returns
     // the path relative to mRootPath
     std::string makeAbsolute(const std::string& string) const;
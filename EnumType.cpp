@@ -388,7 +388,7 @@ void EnumType::emitGlobalTypeDeclarations(Formatter& out) const {
     out << "}  // namespace android\n";
 }
 
-void EnumType::emitPackageTypeDeclarations(Formatter& out) const {
+void EnumType::emitBitwiseOperators(Formatter& out) const {
     emitEnumBitwiseOperator(out, true  /* lhsIsEnum */, true  /* rhsIsEnum */, "|");
     emitEnumBitwiseOperator(out, false /* lhsIsEnum */, true  /* rhsIsEnum */, "|");
     emitEnumBitwiseOperator(out, true  /* lhsIsEnum */, false /* rhsIsEnum */, "|");
@@ -398,16 +398,12 @@ void EnumType::emitPackageTypeDeclarations(Formatter& out) const {
 
     emitBitFieldBitwiseAssignmentOperator(out, "|");
     emitBitFieldBitwiseAssignmentOperator(out, "&");
+}
 
+void EnumType::emitBitfieldToStringBody(Formatter& out) const {
     const ScalarType *scalarType = mStorageType->resolveToScalarType();
     CHECK(scalarType != NULL);
 
-    out << "template<typename>\n"
-        << "static inline std::string toString(" << resolveToScalarType()->getCppArgumentType()
-        << " o);\n";
-    out << "template<>\n"
-        << "inline std::string toString<" << getCppStackType() << ">("
-        << scalarType->getCppArgumentType() << " o) ";
     out.block([&] {
         // include toHexString for scalar types
         out << "using ::android::hardware::details::toHexString;\n"
@@ -436,6 +432,21 @@ void EnumType::emitPackageTypeDeclarations(Formatter& out) const {
 
         out << "return os;\n";
     }).endl().endl();
+}
+
+void EnumType::emitPackageTypeDeclarations(Formatter& out) const {
+    emitBitwiseOperators(out);
+
+    const ScalarType *scalarType = mStorageType->resolveToScalarType();
+    CHECK(scalarType != NULL);
+
+    out << "template<typename>\n"
+        << "static inline std::string toString(" << resolveToScalarType()->getCppArgumentType()
+        << " o);\n";
+    out << "template<>\n"
+        << "inline std::string toString<" << getCppStackType() << ">("
+        << scalarType->getCppArgumentType() << " o) ";
+    emitBitfieldToStringBody(out);
 
     out << "static inline std::string toString(" << getCppArgumentType() << " o) ";
 
@@ -453,6 +464,52 @@ void EnumType::emitPackageTypeDeclarations(Formatter& out) const {
     }).endl().endl();
 }
 
+void EnumType::emitPackageTypeOutOfLineDeclarations(Formatter& out) const {
+    emitBitwiseOperators(out);
+
+    const ScalarType *scalarType = mStorageType->resolveToScalarType();
+    CHECK(scalarType != NULL);
+
+    // Not static, so that the specialization below can be defined in the source file.
+    out << "template<typename>\n"
+        << "std::string toString(" << scalarType->getCppArgumentType() << " o);\n";
+    out << "template<>\n"
+        << "std::string toString<" << getCppStackType() << ">("
+        << scalarType->getCppArgumentType() << " o);\n";
+    out << "std::string toString(" << getCppArgumentType() << " o);\n";
+    out << "void appendToString(" << getCppArgumentType() << " o, std::string* os);\n\n";
+}
+
+void EnumType::emitToStringDefinitions(Formatter& out) const {
+    const ScalarType *scalarType = mStorageType->resolveToScalarType();
+    CHECK(scalarType != NULL);
+
+    out << "template<>\n"
+        << "std::string toString<" << getCppStackType() << ">("
+        << scalarType->getCppArgumentType() << " o) ";
+    emitBitfieldToStringBody(out);
+
+    out << "void appendToString(" << getCppArgumentType() << " o, std::string* os) ";
+    out.block([&] {
+        out << "using ::android::hardware::details::toHexString;\n";
+        forEachValueFromRoot([&](EnumValue* value) {
+            out.sIf("o == " + fullName() + "::" + value->name(), [&] {
+                out << "os->append(\"" << value->name() << "\");\n"
+                    << "return;\n";
+            }).endl();
+        });
+        scalarType->emitHexDump(out, "(*os)",
+            "static_cast<" + scalarType->getCppStackType() + ">(o)");
+    }).endl().endl();
+
+    out << "std::string toString(" << getCppArgumentType() << " o) ";
+    out.block([&] {
+        out << "std::string os;\n"
+            << "appendToString(o, &os);\n"
+            << "return os;\n";
+    }).endl().endl();
+}
+
 void EnumType::emitJavaTypeDeclarations(Formatter& out, bool atTopLevel) const {
     const ScalarType *scalarType = mStorageType->resolveToScalarType();
     CHECK(scalarType != NULL);
@@ -94,6 +94,8 @@ struct EnumType : public Scope {
     void emitTypeForwardDeclaration(Formatter& out) const override;
     void emitGlobalTypeDeclarations(Formatter& out) const override;
     void emitPackageTypeDeclarations(Formatter& out) const override;
+    void emitPackageTypeOutOfLineDeclarations(Formatter& out) const override;
+    void emitToStringDefinitions(Formatter& out) const override;
 
     void emitJavaTypeDeclarations(Formatter& out, bool atTopLevel) const override;
 
@@ -131,6 +133,9 @@ struct EnumType : public Scope {
             Formatter &out,
             const std::string &op) const;
 
+    void emitBitwiseOperators(Formatter& out) const;
+    void emitBitfieldToStringBody(Formatter& out) const;
+
     std::vector<EnumValue *> mValues;
     Reference<Type> mStorageType;
 
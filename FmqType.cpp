@@ -151,6 +151,11 @@ void FmqType::getAlignmentAndSize(
     *size = assertion.size();
 }
 
+size_t FmqType::getEmbeddedParcelObjectCount() const {
+    // The grantors vector and the handle.
+    return 1 + 2;
+}
+
 bool FmqType::needsEmbeddedReadWrite() const {
     return true;
 }
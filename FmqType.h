@@ -57,6 +57,7 @@ struct FmqType : public TemplatedType {
     bool deepIsJavaCompatible(std::unordered_set<const Type*>* visited) const override;
 
     void getAlignmentAndSize(size_t *align, size_t *size) const override;
+    size_t getEmbeddedParcelObjectCount() const override;
 
     bool needsEmbeddedReadWrite() const override;
     bool resultNeedsDeref() const override;
@@ -167,6 +167,11 @@ void HandleType::getAlignmentAndSize(size_t *align, size_t *size) const {
     *size = assertion.size();
 }
 
+size_t HandleType::getEmbeddedParcelObjectCount() const {
+    // The native_handle_t and its fd array.
+    return 2;
+}
+
 void HandleType::emitVtsTypeDeclarations(Formatter& out) const {
     out << "type: " << getVtsType() << "\n";
 }
@@ -63,6 +63,7 @@ struct HandleType : public Type {
     bool useNameInEmitReaderWriterEmbedded(bool isReader) const override;
 
     void getAlignmentAndSize(size_t *align, size_t *size) const override;
+    size_t getEmbeddedParcelObjectCount() const override;
 
     void emitVtsTypeDeclarations(Formatter& out) const override;
 };
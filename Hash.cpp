@@ -16,27 +16,39 @@
 
 #include "Hash.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
 #include <fstream>
 #include <iomanip>
+#include <iostream>
 #include <map>
-#include <regex>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 
 #include <android-base/logging.h>
+#include <android-base/macros.h>
 #include <openssl/sha.h>
 
 namespace android {
 
 const std::vector<uint8_t> Hash::kEmptyHash = std::vector<uint8_t>(SHA256_DIGEST_LENGTH, 0);
 
+static std::map<std::string, Hash> gHashes;
+static std::mutex gHashesMutex;
+
 Hash& Hash::getMutableHash(const std::string& path) {
-    static std::map<std::string, Hash> hashes;
+    std::lock_guard<std::mutex> lock(gHashesMutex);
 
-    auto it = hashes.find(path);
+    auto it = gHashes.find(path);
 
-    if (hashes.find(path) == hashes.end()) {
-        it = hashes.insert(it, {path, Hash(path)});
+    if (gHashes.find(path) == gHashes.end()) {
+        it = gHashes.insert(it, {path, Hash(path)});
     }
 
     return it->second;
@@ -50,23 +62,178 @@ void Hash::clearHash(const std::string& path) {
     getMutableHash(path).mHash = kEmptyHash;
 }
 
-static std::vector<uint8_t> sha256File(const std::string &path) {
-    std::ifstream stream(path);
-    std::stringstream fileStream;
-    fileStream << stream.rdbuf();
-    std::string fileContent = fileStream.str();
+// Digests of files by path, valid as long as the size and modification time of the file are
+// unchanged. Persisted in a file when enabled with Hash::setFileHashCache.
+struct FileHashCache {
+    struct Entry {
+        off_t size;
+        int64_t mtimeSec;
+        int64_t mtimeNsec;
+        std::vector<uint8_t> digest;
+    };
+
+    static constexpr const char* kHeader = "hidl-gen file hash cache v1";
+
+    static int64_t mtimeNsec(const struct stat& st) {
+#ifdef __APPLE__
+        return st.st_mtimespec.tv_nsec;
+#else
+        return st.st_mtim.tv_nsec;
+#endif
+    }
+
+    bool lookup(const std::string& path, const struct stat& st, std::vector<uint8_t>* digest) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cacheFile.empty()) return false;
+
+        auto it = entries.find(path);
+        if (it == entries.end() || it->second.size != st.st_size ||
+            it->second.mtimeSec != st.st_mtime || it->second.mtimeNsec != mtimeNsec(st)) {
+            return false;
+        }
+        *digest = it->second.digest;
+        return true;
+    }
+
+    void store(const std::string& path, const struct stat& st, const std::vector<uint8_t>& digest) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cacheFile.empty()) return;
+
+        entries[path] = {st.st_size, st.st_mtime, mtimeNsec(st), digest};
+        dirty = true;
+    }
+
+    void load(const std::string& file) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == cacheFile) return;
+
+        cacheFile = file;
+        entries.clear();
+        dirty = false;
+        if (cacheFile.empty()) return;
+
+        std::ifstream stream(cacheFile);
+        std::string line;
+        if (!std::getline(stream, line) || line != kHeader) return;
+
+        // <hex digest> <size> <mtime sec> <mtime nsec> <path>
+        while (std::getline(stream, line)) {
+            std::istringstream lineStream(line);
+            std::string hex;
+            Entry entry;
+            if (!(lineStream >> hex >> entry.size >> entry.mtimeSec >> entry.mtimeNsec) ||
+                !parseHex(hex, &entry.digest)) {
+                continue;
+            }
+            lineStream.get();  // space before the path, which may itself contain spaces
+            std::string path;
+            if (!std::getline(lineStream, path) || path.empty()) continue;
+
+            entries[path] = std::move(entry);
+        }
+    }
+
+    void save() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cacheFile.empty() || !dirty) return;
+
+        // Other hidl-gen processes may be reading this file, so it is replaced atomically.
+        const std::string tmpFile = cacheFile + "." + std::to_string(getpid());
 
+        std::ofstream stream(tmpFile);
+        stream << kHeader << "\n";
+        for (const auto& pair : entries) {
+            const Entry& entry = pair.second;
+            stream << Hash::hexString(entry.digest) << " " << entry.size << " " << entry.mtimeSec
+                   << " " << entry.mtimeNsec << " " << pair.first << "\n";
+        }
+        stream.close();
+
+        if (!stream || rename(tmpFile.c_str(), cacheFile.c_str()) != 0) {
+            std::cerr << "WARNING: could not write file hash cache " << cacheFile << std::endl;
+            unlink(tmpFile.c_str());
+            return;
+        }
+        dirty = false;
+    }
+
+    static bool parseHex(const std::string& hex, std::vector<uint8_t>* out) {
+        if (hex.size() != 2 * SHA256_DIGEST_LENGTH) return false;
+
+        const auto nibble = [](char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            return -1;
+        };
+
+        out->resize(SHA256_DIGEST_LENGTH);
+        for (size_t i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+            int high = nibble(hex[2 * i]);
+            int low = nibble(hex[2 * i + 1]);
+            if (high < 0 || low < 0) return false;
+            (*out)[i] = static_cast<uint8_t>(high << 4 | low);
+        }
+        return true;
+    }
+
+    std::mutex mutex;
+    std::string cacheFile;  // empty if disabled
+    std::unordered_map<std::string, Entry> entries;
+    bool dirty = false;
+};
+
+static FileHashCache gFileHashCache;
+
+// A file which can't be read hashes like an empty one.
+static std::vector<uint8_t> sha256File(const std::string &path) {
     std::vector<uint8_t> ret = std::vector<uint8_t>(SHA256_DIGEST_LENGTH);
 
-    SHA256(reinterpret_cast<const uint8_t *>(fileContent.c_str()),
-            fileContent.size(), ret.data());
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    bool cacheable = fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    if (cacheable && gFileHashCache.lookup(path, st, &ret)) {
+        close(fd);
+        return ret;
+    }
+
+    SHA256_CTX context;
+    SHA256_Init(&context);
+
+    if (fd >= 0) {
+        uint8_t buffer[16384];
+        ssize_t n;
+        while ((n = TEMP_FAILURE_RETRY(read(fd, buffer, sizeof(buffer)))) > 0) {
+            SHA256_Update(&context, buffer, n);
+        }
+        cacheable = cacheable && n == 0;
+        close(fd);
+    }
+
+    SHA256_Final(ret.data(), &context);
+
+    if (cacheable) {
+        gFileHashCache.store(path, st, ret);
+    }
 
     return ret;
 }
 
+void Hash::setFileHashCache(const std::string& cacheFile) {
+    gFileHashCache.load(cacheFile);
+}
+
+void Hash::saveFileHashCache() {
+    gFileHashCache.save();
+}
+
 Hash::Hash(const std::string &path)
   : mPath(path),
-    mHash(sha256File(path)) {}
+    mContentHash(sha256File(path)),
+    mHash(mContentHash) {}
+
+Hash::Hash(const std::string& path, const std::vector<uint8_t>& contentHash)
+    : mPath(path), mContentHash(contentHash), mHash(mContentHash) {}
 
 std::string Hash::hexString(const std::vector<uint8_t> &hash) {
     std::ostringstream s;
@@ -81,6 +248,51 @@ std::string Hash::hexString() const {
     return hexString(mHash);
 }
 
+std::string Hash::contentHexString() const {
+    return hexString(mContentHash);
+}
+
+std::string Hash::hexFileHash(const std::string& path) {
+    return hexString(sha256File(path));
+}
+
+bool Hash::readFile(const std::string& path, std::string* contents) {
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool cacheable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    // The size is only a hint, the file may change while it is read.
+    contents->resize(cacheable ? st.st_size : 0);
+    size_t size = 0;
+    ssize_t n;
+    do {
+        if (size == contents->size()) contents->resize(size + 16384);
+        n = TEMP_FAILURE_RETRY(read(fd, &(*contents)[size], contents->size() - size));
+        if (n > 0) size += n;
+    } while (n > 0);
+    contents->resize(size);
+    close(fd);
+    if (n < 0) {
+        std::cerr << "ERROR: could not read " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    cacheable = cacheable && size == static_cast<size_t>(st.st_size);
+
+    std::vector<uint8_t> digest(SHA256_DIGEST_LENGTH);
+    SHA256(reinterpret_cast<const uint8_t*>(contents->data()), contents->size(), digest.data());
+
+    if (cacheable) {
+        gFileHashCache.store(path, st, digest);
+    }
+
+    std::lock_guard<std::mutex> lock(gHashesMutex);
+    gHashes.emplace(path, Hash(path, digest));
+
+    return true;
+}
+
 const std::vector<uint8_t> &Hash::raw() const {
     return mHash;
 }
@@ -89,20 +301,61 @@ const std::string &Hash::getPath() const {
     return mPath;
 }
 
-#define HASH "([0-9a-f]+)"
-#define FQNAME "([^\\s]+)"
-#define SPACES " +"
-#define MAYBE_SPACES " *"
-#define OPTIONAL_COMMENT "(?:#.*)?"
-static const std::regex kHashLine(
-    "(?:"
-        MAYBE_SPACES HASH SPACES FQNAME MAYBE_SPACES
-    ")?"
-    OPTIONAL_COMMENT);
+// Parses a line of current.txt, which is either empty, a comment starting with '#', or
+// "<hash> <fqName>" optionally followed by spaces and a comment. Leading spaces are only
+// allowed before a hash. Returns false if the line is malformed, otherwise hash and fqName
+// are left empty for lines without them.
+static bool parseHashLine(const std::string& line, std::string* hash, std::string* fqName) {
+    hash->clear();
+    fqName->clear();
+
+    // Like '.' in std::regex, comments can't contain '\r'.
+    const auto isComment = [&](size_t pos) {
+        return line[pos] == '#' && line.find('\r', pos) == std::string::npos;
+    };
+
+    if (line.empty() || isComment(0)) return true;
+
+    const auto isSpace = [](char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    };
+
+    size_t pos = line.find_first_not_of(' ');
+    const size_t hashStart = pos;
+    while (pos < line.size() && ((line[pos] >= '0' && line[pos] <= '9') ||
+                                 (line[pos] >= 'a' && line[pos] <= 'f'))) {
+        pos++;
+    }
+    if (pos == hashStart || pos >= line.size() || line[pos] != ' ') return false;
+    *hash = line.substr(hashStart, pos - hashStart);
+
+    while (pos < line.size() && line[pos] == ' ') pos++;
+
+    const size_t fqNameStart = pos;
+    while (pos < line.size() && !isSpace(line[pos])) pos++;
+    if (pos == fqNameStart) return false;
+    const size_t fqNameEnd = pos;
+
+    while (pos < line.size() && line[pos] == ' ') pos++;
+
+    if (pos == line.size() || isComment(pos)) {
+        *fqName = line.substr(fqNameStart, fqNameEnd - fqNameStart);
+        return true;
+    }
+
+    // Otherwise a comment may start inside what was taken for the fqName.
+    const size_t commentStart = line.rfind('#', fqNameEnd - 1);
+    if (commentStart == std::string::npos || commentStart <= fqNameStart ||
+        !isComment(commentStart)) {
+        return false;
+    }
+    *fqName = line.substr(fqNameStart, commentStart - fqNameStart);
+    return true;
+}
 
 struct HashFile {
     static const HashFile *parse(const std::string &path, std::string *err) {
-        static std::map<std::string, HashFile*> hashfiles;
+        std::lock_guard<std::mutex> lock(hashfilesMutex);
         auto it = hashfiles.find(path);
 
         if (it == hashfiles.end()) {
@@ -112,6 +365,14 @@ struct HashFile {
         return it->second;
     }
 
+    static void clear() {
+        std::lock_guard<std::mutex> lock(hashfilesMutex);
+        for (const auto& pair : hashfiles) {
+            delete pair.second;
+        }
+        hashfiles.clear();
+    }
+
     std::vector<std::string> lookup(const std::string &fqName) const {
         auto it = hashes.find(fqName);
 
@@ -133,40 +394,41 @@ private:
         file->path = path;
 
         std::string line;
+        std::string hash;
+        std::string fqName;
         while(std::getline(stream, line)) {
-            std::smatch match;
-            bool valid = std::regex_match(line, match, kHashLine);
-
-            if (!valid) {
+            if (!parseHashLine(line, &hash, &fqName)) {
                 *err = "Error reading line from " + path + ": " + line;
                 delete file;
                 return nullptr;
             }
 
-            CHECK_EQ(match.size(), 3u);
-
-            std::string hash = match.str(1);
-            std::string fqName = match.str(2);
-
             if (hash.size() == 0 && fqName.size() == 0) {
                 continue;
             }
 
-            if (hash.size() == 0 || fqName.size() == 0) {
-                *err = "Hash or fqName empty on " + path + ": " + line;
-                delete file;
-                return nullptr;
-            }
-
             file->hashes[fqName].push_back(hash);
         }
         return file;
     }
 
+    static std::map<std::string, HashFile*> hashfiles;
+    static std::mutex hashfilesMutex;
+
     std::string path;
-    std::map<std::string,std::vector<std::string>> hashes;
+    std::unordered_map<std::string, std::vector<std::string>> hashes;
 };
 
+std::map<std::string, HashFile*> HashFile::hashfiles;
+std::mutex HashFile::hashfilesMutex;
+
+void Hash::clearCaches() {
+    HashFile::clear();
+
+    std::lock_guard<std::mutex> lock(gHashesMutex);
+    gHashes.clear();
+}
+
 std::vector<std::string> Hash::lookupHash(const std::string& path, const std::string& interfaceName,
                                           std::string* err, bool* fileExists) {
     *err = "";
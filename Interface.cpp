@@ -442,6 +442,10 @@ bool Interface::fillDebugMethod(Method *method) const {
 
 static std::map<std::string, Method *> gAllReservedMethods;
 
+void Interface::clearReservedMethods() {
+    gAllReservedMethods.clear();
+}
+
 bool Interface::addMethod(Method *method) {
     if (isIBase()) {
         if (!gAllReservedMethods.emplace(method->name(), method).second) {
@@ -847,7 +851,16 @@ void Interface::emitReaderWriter(
 
 void Interface::emitPackageTypeDeclarations(Formatter& out) const {
     Scope::emitPackageTypeDeclarations(out);
+    emitToString(out);
+}
+
+void Interface::emitPackageTypeOutOfLineDeclarations(Formatter& out) const {
+    // Only types declared in the interface move out of line, its own toString() is short.
+    Scope::emitPackageTypeOutOfLineDeclarations(out);
+    emitToString(out);
+}
 
+void Interface::emitToString(Formatter& out) const {
     out << "static inline std::string toString(" << getCppArgumentType() << " o) ";
 
     out.block([&] {
@@ -44,6 +44,9 @@ struct Interface : public Scope {
     bool addMethod(Method *method);
     bool addAllReservedMethods();
 
+    // Forgets the reserved methods added while parsing IBase, so that it can be parsed again.
+    static void clearReservedMethods();
+
     bool isElidableType() const override;
     bool isInterface() const override;
     bool isBinder() const override;
@@ -115,6 +118,7 @@ struct Interface : public Scope {
             ErrorMode mode) const override;
 
     void emitPackageTypeDeclarations(Formatter& out) const override;
+    void emitPackageTypeOutOfLineDeclarations(Formatter& out) const override;
     void emitTypeDefinitions(Formatter& out, const std::string& prefix) const override;
 
     void getAlignmentAndSize(size_t* align, size_t* size) const override;
@@ -158,6 +162,8 @@ struct Interface : public Scope {
         Formatter& out, const std::string& prefix, const std::vector<const Interface*>& chain,
         std::function<std::string(std::unique_ptr<ConstantExpression>)> byteToString) const;
 
+    void emitToString(Formatter& out) const;
+
     DISALLOW_COPY_AND_ASSIGN(Interface);
 };
 
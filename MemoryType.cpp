@@ -155,6 +155,11 @@ void MemoryType::getAlignmentAndSize(size_t *align, size_t *size) const {
     *size = assertion.size();
 }
 
+size_t MemoryType::getEmbeddedParcelObjectCount() const {
+    // The handle and the name.
+    return 2 + 1;
+}
+
 void MemoryType::emitVtsTypeDeclarations(Formatter& out) const {
     out << "type: " << getVtsType() << "\n";
 }
@@ -62,6 +62,7 @@ struct MemoryType : public Type {
     bool deepIsJavaCompatible(std::unordered_set<const Type*>* visited) const override;
 
     void getAlignmentAndSize(size_t *align, size_t *size) const override;
+    size_t getEmbeddedParcelObjectCount() const override;
 
     void emitVtsTypeDeclarations(Formatter& out) const override;
 };
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "Phase.h"
+
+namespace android {
+
+static ScopedPhase::Listener* gListener = nullptr;
+
+void ScopedPhase::setListener(Listener* listener) {
+    gListener = listener;
+}
+
+bool ScopedPhase::isEnabled() {
+    return gListener != nullptr;
+}
+
+void ScopedPhase::count(const char* name, int64_t delta) {
+    if (gListener != nullptr) gListener->onCounter(name, delta);
+}
+
+ScopedPhase::ScopedPhase(const char* name) : mName(name) {
+    if (gListener != nullptr) gListener->onPhaseBegin(*this);
+}
+
+ScopedPhase::~ScopedPhase() {
+    if (gListener != nullptr) gListener->onPhaseEnd(*this);
+}
+
+void ScopedPhase::addArg(const char* key, const std::string& value) {
+    if (gListener != nullptr) mArgs.emplace_back(key, value);
+}
+
+}  // namespace android
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PHASE_H_
+
+#define PHASE_H_
+
+#include <android-base/macros.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace android {
+
+// Marks one phase of hidl-gen (parsing a file, a post-parse pass, an
+// enforcement, generating an output, ...) for the lifetime of the object.
+// Nothing is recorded unless a listener has been installed, which is how
+// tools such as benchmarks and -T observe where the time goes.
+struct ScopedPhase {
+    // Called on the thread running the phase. Phases nest; with -j a listener
+    // is called from several threads at once.
+    struct Listener {
+        virtual ~Listener() = default;
+
+        virtual void onPhaseBegin(const ScopedPhase& phase) = 0;
+        // Arguments added while the phase ran are available here.
+        virtual void onPhaseEnd(const ScopedPhase& phase) = 0;
+        virtual void onCounter(const char* name, int64_t delta) = 0;
+    };
+
+    // Must be called before any phase starts, and not while phases are running.
+    // The listener is not owned, pass nullptr to remove it.
+    static void setListener(Listener* listener);
+
+    static bool isEnabled();
+
+    // Adds delta to the counter called name.
+    static void count(const char* name, int64_t delta);
+
+    // name must outlive the phase.
+    explicit ScopedPhase(const char* name);
+    ~ScopedPhase();
+
+    const char* name() const { return mName; }
+    const std::vector<std::pair<const char*, std::string>>& args() const { return mArgs; }
+
+    // Attaches key = value to this phase. Ignored unless isEnabled(), callers
+    // which need to compute value should check that first.
+    void addArg(const char* key, const std::string& value);
+
+   private:
+    const char* mName;
+    std::vector<std::pair<const char*, std::string>> mArgs;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedPhase);
+};
+
+}  // namespace android
+
+#endif  // PHASE_H_
@@ -16,6 +16,7 @@
 
 #include "ScalarType.h"
 
+#include <android-base/logging.h>
 #include <hidl-util/Formatter.h>
 
 namespace android {
@@ -205,6 +206,69 @@ void ScalarType::emitReaderWriterWithCast(
     handleError(out, mode);
 }
 
+void ScalarType::emitPackedReaderWriter(
+        Formatter &out,
+        const std::vector<std::pair<const ScalarType *, std::string>> &values,
+        const std::string &parcelObj,
+        bool parcelObjIsPointer,
+        bool isReader,
+        ErrorMode mode) {
+    CHECK(!values.empty());
+
+    // offset of each value, as written by Parcel::write*, which pads to 4 bytes
+    std::vector<size_t> offsets;
+    size_t totalSize = 0;
+    for (const auto &value : values) {
+        size_t align, size;
+        value.first->getAlignmentAndSize(&align, &size);
+
+        offsets.push_back(totalSize);
+        totalSize += (size + 3) & ~static_cast<size_t>(3);
+    }
+
+    const std::string parcelObjDeref =
+        parcelObj + (parcelObjIsPointer ? "->" : ".");
+
+    out.block([&] {
+        out << (isReader ? "const uint8_t *" : "uint8_t *")
+            << "_hidl_inplace = static_cast<"
+            << (isReader ? "const uint8_t *" : "uint8_t *")
+            << ">("
+            << parcelObjDeref
+            << (isReader ? "readInplace(" : "writeInplace(")
+            << totalSize
+            << "));\n";
+
+        out << "_hidl_err = (_hidl_inplace == nullptr) ? "
+            << (isReader ? "::android::NOT_ENOUGH_DATA" : "::android::NO_MEMORY")
+            << " : ::android::OK;\n";
+
+        values.front().first->handleError(out, mode);
+
+        out.sIf("_hidl_inplace != nullptr", [&] {
+            if (!isReader) {
+                out << "memset(_hidl_inplace, 0, " << totalSize << ");\n";
+            }
+
+            for (size_t i = 0; i < values.size(); ++i) {
+                const ScalarType *type = values[i].first;
+                const std::string &name = values[i].second;
+
+                if (isReader && type->getKind() == KIND_BOOL) {
+                    // Parcel::readBool accepts any non-zero byte as true.
+                    out << name << " = _hidl_inplace[" << offsets[i] << "] != 0;\n";
+                } else if (isReader) {
+                    out << "memcpy(&" << name << ", _hidl_inplace + " << offsets[i]
+                        << ", sizeof(" << name << "));\n";
+                } else {
+                    out << "memcpy(_hidl_inplace + " << offsets[i] << ", &" << name
+                        << ", sizeof(" << name << "));\n";
+                }
+            }
+        }).endl();
+    }).endl().endl();
+}
+
 void ScalarType::emitHexDump(
         Formatter &out,
         const std::string &streamName,
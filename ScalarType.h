@@ -78,6 +78,17 @@ struct ScalarType : public Type {
             ErrorMode mode,
             bool needsCast) const;
 
+    // Reads or writes several scalars (or enums and bitfields stored as them) with a single
+    // readInplace/writeInplace call instead of one call each. The parcel contents are the same:
+    // every value is padded to a multiple of four bytes with zeroes.
+    static void emitPackedReaderWriter(
+            Formatter &out,
+            const std::vector<std::pair<const ScalarType *, std::string>> &values,
+            const std::string &parcelObj,
+            bool parcelObjIsPointer,
+            bool isReader,
+            ErrorMode mode);
+
     void emitHexDump(
             Formatter &out,
             const std::string &streamName,
@@ -22,7 +22,6 @@
 
 #include <android-base/logging.h>
 #include <hidl-util/Formatter.h>
-#include <hidl-util/StringHelper.h>
 #include <algorithm>
 #include <iostream>
 #include <vector>
@@ -58,26 +57,27 @@ NamedType *Scope::lookupType(const FQName &fqName) const {
     }
     std::vector<std::string> names = fqName.names();
     CHECK_GT(names.size(), 0u);
-    auto it = mTypeIndexByName.find(names[0]);
 
-    if (it == mTypeIndexByName.end()) {
-        return nullptr;
-    }
+    // Walk down one nested scope per name component.
+    const Scope* scope = this;
+    NamedType* type = nullptr;
+    for (const std::string& name : names) {
+        if (type != nullptr) {
+            if (!type->isScope()) {
+                // more than one names, but the outer name is not a scope
+                return nullptr;
+            }
+            scope = static_cast<Scope*>(type);
+        }
 
-    NamedType *outerType = mTypes[it->second];
-    if (names.size() == 1) {
-        return outerType;
-    }
-    if (!outerType->isScope()) {
-        // more than one names, but the first name is not a scope
-        return nullptr;
+        auto it = scope->mTypeIndexByName.find(name);
+        if (it == scope->mTypeIndexByName.end()) {
+            return nullptr;
+        }
+        type = scope->mTypes[it->second];
     }
-    Scope *outerScope = static_cast<Scope *>(outerType);
-    // *slowly* pop first element
-    names.erase(names.begin());
-    FQName innerName;
-    CHECK(FQName::parse(StringHelper::JoinStrings(names, "."), &innerName));
-    return outerScope->lookupType(innerName);
+
+    return type;
 }
 
 LocalIdentifier *Scope::lookupIdentifier(const std::string & /*name*/) const {
@@ -177,6 +177,12 @@ void Scope::emitPackageTypeDeclarations(Formatter& out) const {
     }
 }
 
+void Scope::emitPackageTypeOutOfLineDeclarations(Formatter& out) const {
+    for (const Type* type : mTypes) {
+        type->emitPackageTypeOutOfLineDeclarations(out);
+    }
+}
+
 void Scope::emitPackageHwDeclarations(Formatter& out) const {
     for (const Type* type : mTypes) {
         type->emitPackageHwDeclarations(out);
@@ -200,6 +206,12 @@ void Scope::emitTypeDefinitions(Formatter& out, const std::string& prefix) const
     }
 }
 
+void Scope::emitToStringDefinitions(Formatter& out) const {
+    for (const Type* type : mTypes) {
+        type->emitToStringDefinitions(out);
+    }
+}
+
 const std::vector<NamedType *> &Scope::getSubTypes() const {
     return mTypes;
 }
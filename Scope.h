@@ -66,11 +66,13 @@ struct Scope : public NamedType {
     void emitTypeDeclarations(Formatter& out) const override;
     void emitGlobalTypeDeclarations(Formatter& out) const override;
     void emitPackageTypeDeclarations(Formatter& out) const override;
+    void emitPackageTypeOutOfLineDeclarations(Formatter& out) const override;
     void emitPackageHwDeclarations(Formatter& out) const override;
 
     void emitJavaTypeDeclarations(Formatter& out, bool atTopLevel) const override;
 
     void emitTypeDefinitions(Formatter& out, const std::string& prefix) const override;
+    void emitToStringDefinitions(Formatter& out) const override;
 
     const std::vector<NamedType *> &getSubTypes() const;
 
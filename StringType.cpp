@@ -219,5 +219,9 @@ void StringType::getAlignmentAndSize(size_t *align, size_t *size) const {
     *size = assertion.size();
 }
 
+size_t StringType::getEmbeddedParcelObjectCount() const {
+    return 1;
+}
+
 }  // namespace android
 
@@ -80,6 +80,7 @@ struct StringType : public Type {
     void emitVtsTypeDeclarations(Formatter& out) const override;
 
     void getAlignmentAndSize(size_t *align, size_t *size) const override;
+    size_t getEmbeddedParcelObjectCount() const override;
 };
 
 }  // namespace android
@@ -621,10 +621,16 @@ void Type::emitGlobalTypeDeclarations(Formatter&) const {}
 
 void Type::emitPackageTypeDeclarations(Formatter&) const {}
 
+void Type::emitPackageTypeOutOfLineDeclarations(Formatter& out) const {
+    emitPackageTypeDeclarations(out);
+}
+
 void Type::emitPackageHwDeclarations(Formatter&) const {}
 
 void Type::emitTypeDefinitions(Formatter&, const std::string&) const {}
 
+void Type::emitToStringDefinitions(Formatter&) const {}
+
 void Type::emitJavaTypeDeclarations(Formatter&, bool) const {}
 
 bool Type::needsEmbeddedReadWrite() const {
@@ -741,6 +747,10 @@ void Type::getAlignmentAndSize(
     CHECK(!"Should not be here.");
 }
 
+size_t Type::getEmbeddedParcelObjectCount() const {
+    return 0;
+}
+
 void Type::appendToExportedTypesVector(
         std::vector<const Type *> * /* exportedTypes */) const {
 }
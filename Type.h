@@ -266,6 +266,10 @@ struct Type : DocCommentable {
     // android::hardware::foo::V1_0
     virtual void emitPackageTypeDeclarations(Formatter& out) const;
 
+    // Like emitPackageTypeDeclarations, but toString() is only declared,
+    // and defined in the source file by emitToStringDefinitions.
+    virtual void emitPackageTypeOutOfLineDeclarations(Formatter& out) const;
+
     // Emit any declarations pertaining to this type that have to be
     // at global scope for transport, e.g. read/writeEmbeddedTo/FromParcel
     // For android.hardware.foo@1.0::*, this will be in namespace
@@ -274,6 +278,11 @@ struct Type : DocCommentable {
 
     virtual void emitTypeDefinitions(Formatter& out, const std::string& prefix) const;
 
+    // Defines what emitPackageTypeOutOfLineDeclarations declared.
+    // For android.hardware.foo@1.0::*, this will be in namespace
+    // android::hardware::foo::V1_0
+    virtual void emitToStringDefinitions(Formatter& out) const;
+
     virtual void emitJavaTypeDeclarations(Formatter& out, bool atTopLevel) const;
 
     virtual bool needsEmbeddedReadWrite() const;
@@ -302,6 +311,11 @@ struct Type : DocCommentable {
 
     virtual void getAlignmentAndSize(size_t *align, size_t *size) const;
 
+    // Number of binder objects (buffers and fd arrays) embedded in a value of
+    // this type when it is written to a Parcel. Objects of vector elements are
+    // not counted, since the number of elements is only known at runtime.
+    virtual size_t getEmbeddedParcelObjectCount() const;
+
     virtual void appendToExportedTypesVector(
             std::vector<const Type *> *exportedTypes) const;
 
@@ -763,5 +763,10 @@ void VectorType::getAlignmentAndSize(size_t *align, size_t *size) const {
     VectorType::getAlignmentAndSizeStatic(align, size);
 }
 
+size_t VectorType::getEmbeddedParcelObjectCount() const {
+    // Only the buffer holding the elements.
+    return 1;
+}
+
 }  // namespace android
 
@@ -128,6 +128,7 @@ struct VectorType : public TemplatedType {
     bool deepContainsPointer(std::unordered_set<const Type*>* visited) const override;
 
     void getAlignmentAndSize(size_t *align, size_t *size) const override;
+    size_t getEmbeddedParcelObjectCount() const override;
     static void getAlignmentAndSizeStatic(size_t *align, size_t *size);
  private:
     // Helper method for emitResolveReferences[Embedded].
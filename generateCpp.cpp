@@ -30,6 +30,7 @@
 #include <hidl-util/StringHelper.h>
 #include <android-base/logging.h>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace android {
@@ -204,6 +205,31 @@ static void implementServiceManagerInteractions(Formatter &out,
     }).endl().endl();
 }
 
+// The stub reads every argument that is not passed by value (strings, vectors other than
+// vectors of interfaces, structs, unions, arrays, memory, fmq descriptors and handles)
+// straight out of the transaction buffer, and hands the implementation a reference to it.
+// Spell out which arguments these are and how long they stay valid.
+static void emitBorrowedArgumentsComment(Formatter& out, const Method* method) {
+    std::vector<std::string> borrowed;
+    for (const auto& arg : method->args()) {
+        const Type& type = arg->type();
+        if (type.resultNeedsDeref() || type.isHandle()) {
+            borrowed.push_back("'" + arg->name() + "'");
+        }
+    }
+
+    if (borrowed.empty()) {
+        return;
+    }
+
+    out << "// " << method->name() << "(): ";
+    out.join(borrowed.begin(), borrowed.end(), ", ", [&](const auto& name) { out << name; });
+    out << (borrowed.size() == 1 ? " is" : " are")
+        << " borrowed from the caller (over hwbinder, from\n"
+        << "// the incoming transaction) and not copied. Only valid until this method returns;\n"
+        << "// copy to keep longer.\n";
+}
+
 void AST::generateInterfaceHeader(Formatter& out) const {
     const Interface *iface = getInterface();
     std::string ifaceName = iface ? iface->localName() : "types";
@@ -289,6 +315,7 @@ void AST::generateInterfaceHeader(Formatter& out) const {
             method->dumpAnnotations(out);
 
             method->emitDocComment(out);
+            emitBorrowedArgumentsComment(out, method);
 
             if (elidedReturn) {
                 out << "virtual ::android::hardware::Return<";
@@ -338,7 +365,7 @@ void AST::generateInterfaceHeader(Formatter& out) const {
         out << "};\n\n";
     }
 
-    mRootScope.emitPackageTypeDeclarations(out);
+    emitPackageTypeDeclarations(out, mRootScope);
 
     out << "\n";
     enterLeaveNamespace(out, false /* enter */);
@@ -391,6 +418,220 @@ void AST::emitTypeDeclarations(Formatter& out) const {
     return mRootScope.emitTypeDeclarations(out);
 }
 
+void AST::emitPackageTypeDeclarations(Formatter& out, const Type& type) const {
+    if (mCoordinator->isOutOfLineToString()) {
+        type.emitPackageTypeOutOfLineDeclarations(out);
+    } else {
+        type.emitPackageTypeDeclarations(out);
+    }
+}
+
+// Returns the type declared at the root of a file which is, or contains, type.
+static const NamedType* getTopLevelType(const Type* type) {
+    while (type->parent() != nullptr && type->parent()->parent() != nullptr) {
+        type = type->parent();
+    }
+    if (type->parent() == nullptr || !type->isNamedType()) return nullptr;
+    return static_cast<const NamedType*>(type);
+}
+
+const NamedType* AST::findRootType(const std::string& localName) const {
+    for (const NamedType* type : mRootScope.getSubTypes()) {
+        if (type->localName() == localName) return type;
+    }
+    CHECK(false) << "Could not find " << localName << " in " << getFilename();
+    return nullptr;
+}
+
+std::vector<const NamedType*> AST::getSplitHeaderTypes(const std::vector<const NamedType*>& roots,
+                                                       std::set<FQName>* includes) const {
+    std::unordered_set<const Type*> visited;
+    std::unordered_set<const NamedType*> needed(roots.begin(), roots.end());
+    std::vector<const Type*> stack(roots.begin(), roots.end());
+
+    while (!stack.empty()) {
+        const Type* type = stack.back();
+        stack.pop_back();
+        if (!visited.insert(type).second) continue;
+
+        const NamedType* topLevel = getTopLevelType(type);
+        if (topLevel != nullptr && topLevel->parent() != &mRootScope) {
+            // Declared in another file, so its whole header is needed.
+            const FQName& fqName = topLevel->fqName();
+            includes->insert(topLevel->isInterface() ? fqName : fqName.getTypesForPackage());
+            continue;
+        }
+        if (topLevel != nullptr && needed.insert(topLevel).second) {
+            stack.push_back(topLevel);
+        }
+
+        for (const Type* definedType : type->getDefinedTypes()) {
+            stack.push_back(definedType);
+        }
+        for (const Reference<Type>* ref : type->getReferences()) {
+            stack.push_back(ref->shallowGet());
+        }
+    }
+
+    std::vector<const NamedType*> types;
+    for (const NamedType* type : mRootScope.getSubTypes()) {
+        if (needed.find(type) != needed.end()) types.push_back(type);
+    }
+    return types;
+}
+
+// Several split headers may declare the same type, so each part of a declaration is
+// guarded on its own. The suffix keeps these guards apart from the file guards ending in _H.
+void AST::emitSplitHeaderTypes(Formatter& out, const std::vector<const NamedType*>& types,
+                               const std::set<FQName>& includes) const {
+    for (const auto& item : includes) {
+        generateCppPackageInclude(out, item, item.name());
+    }
+
+    if (!includes.empty()) {
+        out << "\n";
+    }
+
+    out << "#include <hidl/HidlSupport.h>\n";
+    out << "#include <hidl/MQDescriptor.h>\n";
+    out << "#include <utils/NativeHandle.h>\n";
+    out << "#include <utils/misc.h>\n\n";
+
+    const auto emitGuarded = [&](const std::string& part,
+                                 const std::function<void(const NamedType*)>& emit) {
+        for (const NamedType* type : types) {
+            const std::string guard = makeHeaderGuard("types_" + type->localName()) + "_" + part;
+            out << "#ifndef " << guard << "\n";
+            out << "#define " << guard << "\n";
+            emit(type);
+            out << "#endif  // " << guard << "\n";
+        }
+    };
+
+    enterLeaveNamespace(out, true /* enter */);
+    out << "\n";
+
+    out << "// Forward declaration for forward reference support:\n";
+    emitGuarded("FORWARD", [&](const NamedType* type) { type->emitTypeForwardDeclaration(out); });
+    out << "\n";
+
+    emitGuarded("DECLARATION", [&](const NamedType* type) {
+        type->emitDocComment(out);
+        type->emitTypeDeclarations(out);
+    });
+    emitGuarded("PACKAGE",
+                [&](const NamedType* type) { emitPackageTypeDeclarations(out, *type); });
+
+    out << "\n";
+    enterLeaveNamespace(out, false /* enter */);
+
+    emitGuarded("GLOBAL", [&](const NamedType* type) { type->emitGlobalTypeDeclarations(out); });
+}
+
+void AST::generateTypeHeader(Formatter& out, const std::string& limitToType) const {
+    CHECK(getInterface() == nullptr) << getFilename();
+
+    const std::string guard = makeHeaderGuard("types_" + limitToType);
+
+    out << "#ifndef " << guard << "\n";
+    out << "#define " << guard << "\n\n";
+
+    std::set<FQName> includes;
+    const std::vector<const NamedType*> types =
+            getSplitHeaderTypes({findRootType(limitToType)}, &includes);
+    emitSplitHeaderTypes(out, types, includes);
+
+    out << "\n#endif  // " << guard << "\n";
+}
+
+void AST::generateHwTypeHeader(Formatter& out, const std::string& limitToType) const {
+    CHECK(getInterface() == nullptr) << getFilename();
+
+    const std::string guard = makeHeaderGuard("types_hw" + limitToType);
+
+    out << "#ifndef " << guard << "\n";
+    out << "#define " << guard << "\n\n";
+
+    generateCppPackageInclude(out, mPackage, "types/" + limitToType);
+
+    out << "\n";
+
+    out << "#include <hidl/Status.h>\n";
+    out << "#include <hwbinder/IBinder.h>\n";
+    out << "#include <hwbinder/Parcel.h>\n";
+
+    out << "\n";
+
+    enterLeaveNamespace(out, true /* enter */);
+
+    findRootType(limitToType)->emitPackageHwDeclarations(out);
+
+    enterLeaveNamespace(out, false /* enter */);
+
+    out << "\n#endif  // " << guard << "\n";
+}
+
+void AST::generateTypesUmbrellaHeader(Formatter& out) const {
+    CHECK(getInterface() == nullptr) << getFilename();
+
+    const std::string guard = makeHeaderGuard("types");
+
+    out << "#ifndef " << guard << "\n";
+    out << "#define " << guard << "\n\n";
+
+    // Typedefs get no header of their own, so they are declared here.
+    std::vector<const NamedType*> typeDefs;
+    for (const NamedType* type : mRootScope.getSubTypes()) {
+        if (type->isTypeDef()) {
+            typeDefs.push_back(type);
+        } else {
+            generateCppPackageInclude(out, mPackage, "types/" + type->localName());
+        }
+    }
+
+    if (!typeDefs.empty()) {
+        out << "\n";
+
+        std::set<FQName> includes;
+        const std::vector<const NamedType*> types = getSplitHeaderTypes(typeDefs, &includes);
+        emitSplitHeaderTypes(out, types, includes);
+    }
+
+    out << "\n#endif  // " << guard << "\n";
+}
+
+void AST::generateHwTypesUmbrellaHeader(Formatter& out) const {
+    CHECK(getInterface() == nullptr) << getFilename();
+
+    const std::string guard = makeHeaderGuard("hwtypes");
+
+    out << "#ifndef " << guard << "\n";
+    out << "#define " << guard << "\n\n";
+
+    generateCppPackageInclude(out, mPackage, "types");
+
+    out << "\n";
+
+    // types.cpp includes this header, and needs the imported declarations too.
+    for (const auto &item : mImportedNames) {
+        if (item.name() == "types") {
+            generateCppPackageInclude(out, item, "hwtypes");
+        } else {
+            generateCppPackageInclude(out, item, item.getInterfaceStubName());
+            generateCppPackageInclude(out, item, item.getInterfaceProxyName());
+        }
+    }
+
+    out << "\n";
+
+    for (const NamedType* type : mRootScope.getSubTypes()) {
+        if (type->isTypeDef()) continue;
+        generateCppPackageInclude(out, mPackage, "types/hw" + type->localName());
+    }
+
+    out << "\n#endif  // " << guard << "\n";
+}
+
 static void wrapPassthroughArg(Formatter& out, const NamedReference<Type>* arg,
                                bool addPrefixToName, std::function<void(void)> handleError) {
     if (!arg->type().isInterface()) {
@@ -643,6 +884,7 @@ void AST::generateStubHeader(Formatter& out) const {
                             return;
                         }
 
+                        emitBorrowedArgumentsComment(out, method);
                         out << "static ::android::status_t _hidl_" << method->name() << "(\n";
 
                         out.indent(2,
@@ -782,6 +1024,18 @@ void AST::generateCppSource(Formatter& out) const {
     out << "#include <android/log.h>\n";
     out << "#include <cutils/trace.h>\n";
     out << "#include <hidl/HidlTransportSupport.h>\n\n";
+    if (hasMethodStats()) {
+        out << "#include <inttypes.h>\n";
+        out << "#include <stdio.h>\n";
+        out << "#include <atomic>\n";
+        out << "#include <chrono>\n";
+    }
+    if (proxyStartsThreadPool()) {
+        out << "#include <mutex>\n";
+    }
+    if (hasMethodStats() || proxyStartsThreadPool()) {
+        out << "\n";
+    }
     if (iface) {
         // This is a no-op for IServiceManager itself.
         out << "#include <android/hidl/manager/1.0/IServiceManager.h>\n";
@@ -809,6 +1063,10 @@ void AST::generateCppSource(Formatter& out) const {
 
     generateTypeSource(out, iface ? iface->localName() : "");
 
+    if (mCoordinator->isOutOfLineToString()) {
+        mRootScope.emitToStringDefinitions(out);
+    }
+
     if (iface) {
         const Interface* iface = mRootScope.getInterface();
 
@@ -865,6 +1123,10 @@ void AST::generateCppSource(Formatter& out) const {
         });
         out << "};\n\n";
 
+        if (hasMethodStats()) {
+            generateMethodStats(out);
+        }
+
         generateInterfaceSource(out);
         generateProxySource(out, iface->fqName());
         generateStubSource(out, iface);
@@ -932,6 +1194,33 @@ void AST::emitCppReaderWriter(Formatter& out, const std::string& parcelObj, bool
             mode);
 }
 
+void AST::emitCppReaderWriters(Formatter& out, const std::string& parcelObj,
+                               bool parcelObjIsPointer,
+                               const std::vector<NamedReference<Type>*>& args, bool isReader,
+                               Type::ErrorMode mode, bool addPrefixToName) const {
+    for (size_t i = 0; i < args.size();) {
+        std::vector<std::pair<const ScalarType*, std::string>> scalars;
+        for (size_t j = i; j < args.size(); ++j) {
+            const ScalarType* scalarType = args[j]->type().resolveToScalarType();
+            if (scalarType == nullptr) break;
+
+            scalars.push_back(
+                {scalarType, addPrefixToName ? ("_hidl_out_" + args[j]->name()) : args[j]->name()});
+        }
+
+        if (scalars.size() >= 2) {
+            ScalarType::emitPackedReaderWriter(out, scalars, parcelObj, parcelObjIsPointer,
+                                               isReader, mode);
+            i += scalars.size();
+            continue;
+        }
+
+        emitCppReaderWriter(out, parcelObj, parcelObjIsPointer, args[i], isReader, mode,
+                            addPrefixToName);
+        ++i;
+    }
+}
+
 void AST::emitCppResolveReferences(Formatter& out, const std::string& parcelObj,
                                    bool parcelObjIsPointer, const NamedReference<Type>* arg,
                                    bool isReader, Type::ErrorMode mode,
@@ -949,6 +1238,24 @@ void AST::emitCppResolveReferences(Formatter& out, const std::string& parcelObj,
     }
 }
 
+void AST::emitCppMarshalArgs(Formatter& out, const std::string& parcelObj,
+                             bool parcelObjIsPointer,
+                             const std::vector<NamedReference<Type>*>& args, bool isReader,
+                             Type::ErrorMode mode, bool addPrefixToName) const {
+    // First DFS: read/write all buffers and resolve pointers for parent.
+    emitCppReaderWriters(out, parcelObj, parcelObjIsPointer, args, isReader, mode,
+                         addPrefixToName);
+
+    // Second DFS: resolve references. This cannot be folded into the first pass: a ref<T> may
+    // point at a buffer which is only written (or read) later in the traversal, so every
+    // buffer has to be in place first. Types without ref<T> emit nothing here, so in practice
+    // the generated code only has a single traversal.
+    for (const auto& arg : args) {
+        emitCppResolveReferences(out, parcelObj, parcelObjIsPointer, arg, isReader, mode,
+                                 addPrefixToName);
+    }
+}
+
 void AST::generateProxyMethodSource(Formatter& out, const std::string& klassName,
                                     const Method* method, const Interface* superInterface) const {
     method->generateCppSignature(out,
@@ -997,6 +1304,67 @@ void AST::generateProxyMethodSource(Formatter& out, const std::string& klassName
     }).endl().endl();
 }
 
+// hwbinder writes scalars into the data of a Parcel inline, interfaces as a
+// flat_binder_object, and anything else as a binder_buffer_object pointing at the
+// value, followed by one for each buffer embedded in it.
+static constexpr size_t kFlatBinderObjectSize = 24;
+static constexpr size_t kBinderBufferObjectSize = 40;
+// Status::ok() is written as its exception code alone.
+static constexpr size_t kStatusOkSize = 4;
+
+static size_t alignToParcel(size_t size) {
+    return (size + 3) & ~static_cast<size_t>(3);
+}
+
+// Size of the Parcel data written for args, as far as it is known statically.
+static size_t estimateParcelDataSize(const std::vector<NamedReference<Type>*>& args) {
+    size_t size = 0;
+    for (const auto& arg : args) {
+        const Type& type = arg->type();
+        const ScalarType* scalarType = type.resolveToScalarType();
+
+        if (scalarType != nullptr) {
+            size_t align, scalarSize;
+            scalarType->getAlignmentAndSize(&align, &scalarSize);
+            size += alignToParcel(scalarSize);
+        } else if (type.isInterface()) {
+            size += kFlatBinderObjectSize;
+        } else {
+            size += kBinderBufferObjectSize * (1 + type.getEmbeddedParcelObjectCount());
+        }
+    }
+    return size;
+}
+
+// Parcel grows its data to 1.5 times what the first write needs, so only sizes beyond that
+// save a reallocation.
+static void emitSetDataCapacity(Formatter& out, const std::string& parcel, size_t firstWrite,
+                                size_t size) {
+    if (size <= firstWrite * 3 / 2) return;
+
+    out << parcel << "setDataCapacity(" << size << " /* estimated */);\n";
+}
+
+// Whether the proxy of method writes only the interface token and scalars to _hidl_data.
+// Everything else is written as a binder object or a buffer object.
+static bool writesOnlyFlatData(const Method* method) {
+    for (const auto& arg : method->args()) {
+        if (arg->type().resolveToScalarType() == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool hasInterfaceArgument(const Method* method) {
+    for (const auto& arg : method->args()) {
+        if (arg->type().isInterface()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void AST::generateStaticProxyMethodSource(Formatter& out, const std::string& klassName,
                                           const Method* method) const {
     if (method->isHidlReserved() && method->overridesCppImpl(IMPL_PROXY)) {
@@ -1039,50 +1407,43 @@ void AST::generateStaticProxyMethodSource(Formatter& out, const std::string& kla
             InstrumentationEvent::CLIENT_API_ENTRY,
             method);
 
-    out << "::android::hardware::Parcel _hidl_data;\n";
+    if (mCoordinator->isReuseParcels() && writesOnlyFlatData(method)) {
+        out << "_hidl_ParcelLease _hidl_data_lease;\n";
+        out << "::android::hardware::Parcel& _hidl_data = _hidl_data_lease.parcel();\n";
+    } else {
+        out << "::android::hardware::Parcel _hidl_data;\n";
+    }
     out << "::android::hardware::Parcel _hidl_reply;\n";
     out << "::android::status_t _hidl_err;\n";
-    out << "::android::hardware::Status _hidl_status;\n\n";
+    out << "::android::hardware::Status _hidl_status;\n";
+    generateMethodStatsScope(out, "_hidl_proxyStats", method, "&_hidl_status");
+    out << "\n";
 
     declareCppReaderLocals(
             out, method->results(), true /* forResults */);
 
+    // writeInterfaceToken writes the descriptor as a C string.
+    const size_t tokenSize = alignToParcel(getInterface()->fqName().string().size() + 1);
+    emitSetDataCapacity(out, "_hidl_data.", tokenSize,
+                        tokenSize + estimateParcelDataSize(method->args()));
+
     out << "_hidl_err = _hidl_data.writeInterfaceToken(";
     out << klassName;
     out << "::descriptor);\n";
     out << "if (_hidl_err != ::android::OK) { goto _hidl_error; }\n\n";
 
-    bool hasInterfaceArgument = false;
-    // First DFS: write all buffers and resolve pointers for parent
-    for (const auto &arg : method->args()) {
-        if (arg->type().isInterface()) {
-            hasInterfaceArgument = true;
-        }
-        emitCppReaderWriter(
-                out,
-                "_hidl_data",
-                false /* parcelObjIsPointer */,
-                arg,
-                false /* reader */,
-                Type::ErrorMode_Goto,
-                false /* addPrefixToName */);
-    }
-
-    // Second DFS: resolve references.
-    for (const auto &arg : method->args()) {
-        emitCppResolveReferences(
-                out,
-                "_hidl_data",
-                false /* parcelObjIsPointer */,
-                arg,
-                false /* reader */,
-                Type::ErrorMode_Goto,
-                false /* addPrefixToName */);
-    }
-
-    if (hasInterfaceArgument) {
+    emitCppMarshalArgs(
+            out,
+            "_hidl_data",
+            false /* parcelObjIsPointer */,
+            method->args(),
+            false /* reader */,
+            Type::ErrorMode_Goto,
+            false /* addPrefixToName */);
+
+    if (hasInterfaceArgument(method)) {
         // Start binder threadpool to handle incoming transactions
-        out << "::android::hardware::ProcessState::self()->startThreadPool();\n";
+        out << "_hidl_startThreadPoolOnce();\n";
     }
     out << "_hidl_err = ::android::hardware::IInterface::asBinder(_hidl_this)->transact("
         << method->getSerialId()
@@ -1103,29 +1464,14 @@ void AST::generateStaticProxyMethodSource(Formatter& out, const std::string& kla
         out << "if (!_hidl_status.isOk()) { return _hidl_status; }\n\n";
 
 
-        // First DFS: write all buffers and resolve pointers for parent
-        for (const auto &arg : method->results()) {
-            emitCppReaderWriter(
-                    out,
-                    "_hidl_reply",
-                    false /* parcelObjIsPointer */,
-                    arg,
-                    true /* reader */,
-                    Type::ErrorMode_Goto,
-                    true /* addPrefixToName */);
-        }
-
-        // Second DFS: resolve references.
-        for (const auto &arg : method->results()) {
-            emitCppResolveReferences(
-                    out,
-                    "_hidl_reply",
-                    false /* parcelObjIsPointer */,
-                    arg,
-                    true /* reader */,
-                    Type::ErrorMode_Goto,
-                    true /* addPrefixToName */);
-        }
+        emitCppMarshalArgs(
+                out,
+                "_hidl_reply",
+                false /* parcelObjIsPointer */,
+                method->results(),
+                true /* reader */,
+                Type::ErrorMode_Goto,
+                true /* addPrefixToName */);
 
         if (returnsValue && elidedReturn == nullptr) {
             out << "_hidl_cb(";
@@ -1172,9 +1518,114 @@ void AST::generateStaticProxyMethodSource(Formatter& out, const std::string& kla
     out << "}\n\n";
 }
 
+// Emits _hidl_ParcelLease, which proxies use for _hidl_data when hidl-gen runs with -P.
+// hardware::Parcel has no public way to forget the objects and embedded buffers written to it,
+// or the state used to look up the parents of embedded buffers, so only methods which write
+// nothing but flat data use it (see writesOnlyFlatData). For those, setDataSize(0) discards
+// everything that was written. The reply is not kept: after a transaction it refers to a
+// buffer of the binder driver, which goes back to the driver once the reply is reset.
+static void emitParcelLease(Formatter& out) {
+    out << "namespace {\n\n";
+    out << "// Lends out the data Parcel kept by the calling thread, so that consecutive calls\n"
+        << "// reuse its buffer. A call made while it is lent out, e.g. from a callback, gets a\n"
+        << "// Parcel of its own.\n";
+    out << "class _hidl_ParcelLease {\n";
+    out << "  public:\n";
+    out.indent([&] {
+        out << "_hidl_ParcelLease() ";
+        out.block([&] {
+            out << "ThreadParcel& cached = threadParcel();\n";
+            out.sIf("!cached.inUse", [&] {
+                out << "cached.inUse = true;\n"
+                    << "mCached = &cached;\n"
+                    << "mParcel = &cached.parcel;\n";
+            }).sElse([&] {
+                out << "mOwned.reset(new ::android::hardware::Parcel());\n"
+                    << "mParcel = mOwned.get();\n";
+            }).endl();
+        }).endl().endl();
+
+        out << "~_hidl_ParcelLease() ";
+        out.block([&] {
+            out.sIf("mCached == nullptr", [&] {
+                out << "return;\n";
+            }).endl();
+            out << "// Only the interface token and scalars are written to it, so this empties\n"
+                << "// it while keeping its buffer.\n";
+            out << "mParcel->setDataSize(0);\n"
+                << "mParcel->setDataPosition(0);\n"
+                << "mCached->inUse = false;\n";
+        }).endl().endl();
+
+        out << "::android::hardware::Parcel& parcel() { return *mParcel; }\n";
+    });
+    out << "\n";
+    out << "  private:\n";
+    out.indent([&] {
+        out << "struct ThreadParcel ";
+        out.block([&] {
+            out << "::android::hardware::Parcel parcel;\n"
+                << "bool inUse = false;\n";
+        });
+        out << ";\n\n";
+        out << "static ThreadParcel& threadParcel() ";
+        out.block([&] {
+            out << "static thread_local ThreadParcel tParcel;\n"
+                << "return tParcel;\n";
+        }).endl().endl();
+        out << "ThreadParcel* mCached = nullptr;\n"
+            << "std::unique_ptr<::android::hardware::Parcel> mOwned;\n"
+            << "::android::hardware::Parcel* mParcel;\n";
+    });
+    out << "};\n\n";
+    out << "}  // namespace\n\n";
+}
+
+// Starting the threadpool takes the ProcessState lock, so proxies only do it on the first
+// call that passes an interface, which the remote side may call back into.
+static void emitStartThreadPoolOnce(Formatter& out) {
+    out << "namespace {\n\n";
+    out << "void _hidl_startThreadPoolOnce() ";
+    out.block([&] {
+        out << "static std::once_flag _hidl_threadPoolOnce;\n"
+            << "std::call_once(_hidl_threadPoolOnce, [] ";
+        out.block([&] {
+            out << "::android::hardware::ProcessState::self()->startThreadPool();\n";
+        });
+        out << ");\n";
+    }).endl().endl();
+    out << "}  // namespace\n\n";
+}
+
+bool AST::anyProxyMethod(bool (*predicate)(const Method*)) const {
+    const Interface* iface = getInterface();
+    if (iface == nullptr) {
+        return false;
+    }
+
+    const std::vector<Method*> methods = iface->methods();
+    // the methods for which generateStaticProxyMethodSource generates code
+    return std::any_of(methods.begin(), methods.end(), [&](const Method* method) {
+        return !(method->isHidlReserved() && method->overridesCppImpl(IMPL_PROXY)) &&
+               predicate(method);
+    });
+}
+
+bool AST::proxyStartsThreadPool() const {
+    return anyProxyMethod(hasInterfaceArgument);
+}
+
 void AST::generateProxySource(Formatter& out, const FQName& fqName) const {
     const std::string klassName = fqName.getInterfaceProxyName();
 
+    if (mCoordinator->isReuseParcels() && anyProxyMethod(writesOnlyFlatData)) {
+        emitParcelLease(out);
+    }
+
+    if (proxyStartsThreadPool()) {
+        emitStartThreadPoolOnce(out);
+    }
+
     out << klassName
         << "::"
         << klassName
@@ -1419,6 +1870,7 @@ void AST::generateStaticStubMethodSource(Formatter& out, const FQName& fqName,
     out << "#endif // __ANDROID_DEBUGGABLE__\n\n";
 
     out << "::android::status_t _hidl_err = ::android::OK;\n";
+    generateMethodStatsScope(out, "_hidl_stubStats", method, "&_hidl_err");
 
     out << "if (!_hidl_data.enforceInterface("
         << klassName
@@ -1432,29 +1884,14 @@ void AST::generateStaticStubMethodSource(Formatter& out, const FQName& fqName,
 
     declareCppReaderLocals(out, method->args(), false /* forResults */);
 
-    // First DFS: write buffers
-    for (const auto &arg : method->args()) {
-        emitCppReaderWriter(
-                out,
-                "_hidl_data",
-                false /* parcelObjIsPointer */,
-                arg,
-                true /* reader */,
-                Type::ErrorMode_Return,
-                false /* addPrefixToName */);
-    }
-
-    // Second DFS: resolve references
-    for (const auto &arg : method->args()) {
-        emitCppResolveReferences(
-                out,
-                "_hidl_data",
-                false /* parcelObjIsPointer */,
-                arg,
-                true /* reader */,
-                Type::ErrorMode_Return,
-                false /* addPrefixToName */);
-    }
+    emitCppMarshalArgs(
+            out,
+            "_hidl_data",
+            false /* parcelObjIsPointer */,
+            method->args(),
+            true /* reader */,
+            Type::ErrorMode_Return,
+            false /* addPrefixToName */);
 
     generateCppInstrumentationCall(
             out,
@@ -1488,6 +1925,8 @@ void AST::generateStaticStubMethodSource(Formatter& out, const FQName& fqName,
         });
 
         out << ");\n\n";
+        emitSetDataCapacity(out, "_hidl_reply->", kStatusOkSize,
+                            kStatusOkSize + estimateParcelDataSize(method->results()));
         out << "::android::hardware::writeToParcel(::android::hardware::Status::ok(), "
             << "_hidl_reply);\n\n";
 
@@ -1551,32 +1990,19 @@ void AST::generateStaticStubMethodSource(Formatter& out, const FQName& fqName,
             out << "}\n";
             out << "_hidl_callbackCalled = true;\n\n";
 
+            emitSetDataCapacity(out, "_hidl_reply->", kStatusOkSize,
+                                kStatusOkSize + estimateParcelDataSize(method->results()));
             out << "::android::hardware::writeToParcel(::android::hardware::Status::ok(), "
                 << "_hidl_reply);\n\n";
 
-            // First DFS: buffers
-            for (const auto &arg : method->results()) {
-                emitCppReaderWriter(
-                        out,
-                        "_hidl_reply",
-                        true /* parcelObjIsPointer */,
-                        arg,
-                        false /* reader */,
-                        Type::ErrorMode_Ignore,
-                        true /* addPrefixToName */);
-            }
-
-            // Second DFS: resolve references
-            for (const auto &arg : method->results()) {
-                emitCppResolveReferences(
-                        out,
-                        "_hidl_reply",
-                        true /* parcelObjIsPointer */,
-                        arg,
-                        false /* reader */,
-                        Type::ErrorMode_Ignore,
-                        true /* addPrefixToName */);
-            }
+            emitCppMarshalArgs(
+                    out,
+                    "_hidl_reply",
+                    true /* parcelObjIsPointer */,
+                    method->results(),
+                    false /* reader */,
+                    Type::ErrorMode_Ignore,
+                    true /* addPrefixToName */);
 
             generateCppInstrumentationCall(
                     out,
@@ -1696,6 +2122,147 @@ void AST::generatePassthroughHeader(Formatter& out) const {
     out << "\n#endif  // " << guard << "\n";
 }
 
+bool AST::hasMethodStats() const {
+    const Interface* iface = getInterface();
+    return mCoordinator->isMethodStats() && iface != nullptr &&
+           !iface->userDefinedMethods().empty();
+}
+
+void AST::generateMethodStats(Formatter& out) const {
+    const Interface* iface = getInterface();
+    const std::vector<Method*>& methods = iface->userDefinedMethods();
+    const std::string count = std::to_string(methods.size());
+
+    out << "namespace {\n\n";
+    out << "// Calls, errors and latencies of the methods of " << iface->localName()
+        << ", as called through " << iface->getProxyName() << "\n"
+        << "// and as served by " << iface->getStubName()
+        << ". Bucket i of the latency histogram counts the calls which\n"
+        << "// took less than 2^i microseconds, the last bucket also the slower ones.\n";
+    out << "struct _hidl_MethodStats ";
+    out.block([&] {
+        out << "static constexpr size_t kBuckets = 24;\n\n";
+        out << "std::atomic<uint64_t> calls;\n"
+            << "std::atomic<uint64_t> errors;\n"
+            << "std::atomic<uint64_t> latency[kBuckets];\n\n";
+        out << "void record(std::chrono::steady_clock::duration elapsed, bool failed) ";
+        out.block([&] {
+            out << "const int64_t us =\n";
+            out.indent(2, [&] {
+                out << "std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();\n";
+            });
+            out << "size_t bucket = 0;\n";
+            out << "while (bucket + 1 < kBuckets && us >= (INT64_C(1) << bucket)) ";
+            out.block([&] { out << "++bucket;\n"; }).endl();
+            out << "calls.fetch_add(1, std::memory_order_relaxed);\n";
+            out.sIf("failed", [&] {
+                out << "errors.fetch_add(1, std::memory_order_relaxed);\n";
+            }).endl();
+            out << "latency[bucket].fetch_add(1, std::memory_order_relaxed);\n";
+        }).endl();
+    });
+    out << ";\n\n";
+
+    out << "// Records a call in the stats of its method when the call returns.\n";
+    out << "class _hidl_MethodStatsScope {\n";
+    out << "  public:\n";
+    out.indent([&] {
+        out << "_hidl_MethodStatsScope(_hidl_MethodStats* stats, const ::android::status_t* err)\n";
+        out.indent(2, [&] { out << ": mStats(stats), mErr(err), mStatus(nullptr) {}\n"; });
+        out << "_hidl_MethodStatsScope(_hidl_MethodStats* stats, "
+            << "const ::android::hardware::Status* status)\n";
+        out.indent(2, [&] { out << ": mStats(stats), mErr(nullptr), mStatus(status) {}\n\n"; });
+        out << "~_hidl_MethodStatsScope() ";
+        out.block([&] {
+            out << "mStats->record(std::chrono::steady_clock::now() - mStart,\n";
+            out.indent(2, [&] {
+                out << "mErr != nullptr ? *mErr != ::android::OK : !mStatus->isOk());\n";
+            });
+        }).endl();
+    });
+    out << "\n  private:\n";
+    out.indent([&] {
+        out << "_hidl_MethodStats* mStats;\n"
+            << "const ::android::status_t* mErr;\n"
+            << "const ::android::hardware::Status* mStatus;\n"
+            << "const std::chrono::steady_clock::time_point mStart = "
+            << "std::chrono::steady_clock::now();\n";
+    });
+    out << "};\n\n";
+
+    out << "const char* const _hidl_methodNames[] = {";
+    out.join(methods.begin(), methods.end(), ", ",
+             [&](const Method* method) { out << "\"" << method->name() << "\""; });
+    out << "};\n";
+    out << "_hidl_MethodStats _hidl_proxyStats[" << count << "];\n";
+    out << "_hidl_MethodStats _hidl_stubStats[" << count << "];\n\n";
+
+    out << "void _hidl_dumpMethodStats(int fd, const char* side, "
+        << "const _hidl_MethodStats* stats) ";
+    out.block([&] {
+        out << "for (size_t i = 0; i < " << count << "; ++i) ";
+        out.block([&] {
+            out << "const uint64_t calls = stats[i].calls.load(std::memory_order_relaxed);\n";
+            out.sIf("calls == 0", [&] { out << "continue;\n"; }).endl();
+            out << "dprintf(fd, \"%s %s: calls=%\" PRIu64 \" errors=%\" PRIu64 \" latency_us:\", "
+                << "side,\n";
+            out.indent(2, [&] {
+                out << "_hidl_methodNames[i], calls, "
+                    << "stats[i].errors.load(std::memory_order_relaxed));\n";
+            });
+            out << "for (size_t b = 0; b < _hidl_MethodStats::kBuckets; ++b) ";
+            out.block([&] {
+                out << "const uint64_t n = stats[i].latency[b].load(std::memory_order_relaxed);\n";
+                out.sIf("n == 0", [&] { out << "continue;\n"; }).endl();
+                out.sIf("b + 1 < _hidl_MethodStats::kBuckets", [&] {
+                    out << "dprintf(fd, \" <%\" PRIu64 \"=%\" PRIu64, UINT64_C(1) << b, n);\n";
+                }).sElse([&] {
+                    out << "dprintf(fd, \" >=%\" PRIu64 \"=%\" PRIu64, "
+                        << "UINT64_C(1) << (b - 1), n);\n";
+                }).endl();
+            }).endl();
+            out << "dprintf(fd, \"\\n\");\n";
+        }).endl();
+    }).endl().endl();
+
+    out << "// Prints the stats to the first fd of the handle if the options contain "
+        << "\"--stats\".\n";
+    out << "void _hidl_debugMethodStats(const ::android::hardware::hidl_handle& fd,\n";
+    out.indent(2, [&] {
+        out << "const ::android::hardware::hidl_vec<::android::hardware::hidl_string>& "
+            << "options) ";
+    });
+    out.block([&] {
+        out.sIf("fd.getNativeHandle() == nullptr || fd->numFds < 1", [&] {
+            out << "return;\n";
+        }).endl();
+        out << "for (const auto& option : options) ";
+        out.block([&] {
+            out.sIf("option == \"--stats\"", [&] {
+                out << "dprintf(fd->data[0], \"%s\\n\", " << iface->localName()
+                    << "::descriptor);\n";
+                out << "_hidl_dumpMethodStats(fd->data[0], \"proxy\", _hidl_proxyStats);\n";
+                out << "_hidl_dumpMethodStats(fd->data[0], \"stub\", _hidl_stubStats);\n";
+                out << "return;\n";
+            }).endl();
+        }).endl();
+    }).endl().endl();
+    out << "}  // namespace\n\n";
+}
+
+void AST::generateMethodStatsScope(Formatter& out, const std::string& table,
+                                   const Method* method, const std::string& result) const {
+    if (!hasMethodStats() || method->isHidlReserved()) {
+        return;
+    }
+    const std::vector<Method*>& methods = getInterface()->userDefinedMethods();
+    const size_t index = std::find(methods.begin(), methods.end(), method) - methods.begin();
+    CHECK(index < methods.size()) << method->name() << " is not a method of this interface";
+
+    out << "_hidl_MethodStatsScope _hidl_stats(&" << table << "[" << index << "], " << result
+        << ");\n";
+}
+
 void AST::generateInterfaceSource(Formatter& out) const {
     const Interface* iface = mRootScope.getInterface();
 
@@ -1711,6 +2278,11 @@ void AST::generateInterfaceSource(Formatter& out) const {
         method->generateCppSignature(out, iface->localName());
         if (reserved) {
             out.block([&]() {
+                // Reserved methods are filled in while parsing, so the stats dump, which
+                // depends on the generation options, goes ahead of the debug() they fill in.
+                if (method->name() == "debug" && hasMethodStats()) {
+                    out << "_hidl_debugMethodStats(fd, options);\n";
+                }
                 method->cppImpl(IMPL_INTERFACE, out);
             }).endl();
         }
@@ -1845,20 +2417,15 @@ void AST::generateCppInstrumentationCall(
         const Method *method) const {
     generateCppAtraceCall(out, event, method);
 
-    out << "#ifdef __ANDROID_DEBUGGABLE__\n";
-    out << "if (UNLIKELY(mEnableInstrumentation)) {\n";
-    out.indent();
-    out << "std::vector<void *> _hidl_args;\n";
     std::string event_str = "";
+    std::vector<std::string> argPointers;
     switch (event) {
         case SERVER_API_ENTRY:
         {
             event_str = "InstrumentationEvent::SERVER_API_ENTRY";
             for (const auto &arg : method->args()) {
-                out << "_hidl_args.push_back((void *)"
-                    << (arg->type().resultNeedsDeref() ? "" : "&")
-                    << arg->name()
-                    << ");\n";
+                argPointers.push_back(std::string("(void *)") +
+                                      (arg->type().resultNeedsDeref() ? "" : "&") + arg->name());
             }
             break;
         }
@@ -1866,9 +2433,7 @@ void AST::generateCppInstrumentationCall(
         {
             event_str = "InstrumentationEvent::SERVER_API_EXIT";
             for (const auto &arg : method->results()) {
-                out << "_hidl_args.push_back((void *)&_hidl_out_"
-                    << arg->name()
-                    << ");\n";
+                argPointers.push_back("(void *)&_hidl_out_" + arg->name());
             }
             break;
         }
@@ -1876,9 +2441,7 @@ void AST::generateCppInstrumentationCall(
         {
             event_str = "InstrumentationEvent::CLIENT_API_ENTRY";
             for (const auto &arg : method->args()) {
-                out << "_hidl_args.push_back((void *)&"
-                    << arg->name()
-                    << ");\n";
+                argPointers.push_back("(void *)&" + arg->name());
             }
             break;
         }
@@ -1886,11 +2449,9 @@ void AST::generateCppInstrumentationCall(
         {
             event_str = "InstrumentationEvent::CLIENT_API_EXIT";
             for (const auto &arg : method->results()) {
-                out << "_hidl_args.push_back((void *)"
-                    << (arg->type().resultNeedsDeref() ? "" : "&")
-                    << "_hidl_out_"
-                    << arg->name()
-                    << ");\n";
+                argPointers.push_back(std::string("(void *)") +
+                                      (arg->type().resultNeedsDeref() ? "" : "&") + "_hidl_out_" +
+                                      arg->name());
             }
             break;
         }
@@ -1898,9 +2459,7 @@ void AST::generateCppInstrumentationCall(
         {
             event_str = "InstrumentationEvent::PASSTHROUGH_ENTRY";
             for (const auto &arg : method->args()) {
-                out << "_hidl_args.push_back((void *)&"
-                    << arg->name()
-                    << ");\n";
+                argPointers.push_back("(void *)&" + arg->name());
             }
             break;
         }
@@ -1908,9 +2467,7 @@ void AST::generateCppInstrumentationCall(
         {
             event_str = "InstrumentationEvent::PASSTHROUGH_EXIT";
             for (const auto &arg : method->results()) {
-                out << "_hidl_args.push_back((void *)&_hidl_out_"
-                    << arg->name()
-                    << ");\n";
+                argPointers.push_back("(void *)&_hidl_out_" + arg->name());
             }
             break;
         }
@@ -1920,6 +2477,18 @@ void AST::generateCppInstrumentationCall(
         }
     }
 
+    out << "#ifdef __ANDROID_DEBUGGABLE__\n";
+    out << "if (UNLIKELY(mEnableInstrumentation) && !mInstrumentationCallbacks.empty()) {\n";
+    out.indent();
+    // Collect the arguments on the stack, and hand them to the callbacks in a vector of the
+    // calling thread, so that its capacity is reused from call to call. Methods without
+    // arguments pass no vector at all.
+    if (!argPointers.empty()) {
+        out << "void *_hidl_argv[] = {" << StringHelper::JoinStrings(argPointers, ", ") << "};\n";
+        out << "static thread_local std::vector<void *> _hidl_args;\n";
+        out << "_hidl_args.assign(std::begin(_hidl_argv), std::end(_hidl_argv));\n";
+    }
+
     const Interface* iface = mRootScope.getInterface();
 
     out << "for (const auto &callback: mInstrumentationCallbacks) {\n";
@@ -1934,7 +2503,7 @@ void AST::generateCppInstrumentationCall(
         << iface->localName()
         << "\", \""
         << method->name()
-        << "\", &_hidl_args);\n";
+        << "\", " << (argPointers.empty() ? "nullptr" : "&_hidl_args") << ");\n";
     out.unindent();
     out << "}\n";
     out.unindent();
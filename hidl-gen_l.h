@@ -20,13 +20,13 @@
 
 #include <utils/Errors.h>
 
-#include <stdio.h>
+#include <string>
 
 namespace android {
 
 // entry-point for file parsing
 // - contents of file are added to the AST
-// - expects file to already be open
-status_t parseFile(AST* ast, std::unique_ptr<FILE, std::function<void(FILE*)>> file);
+// - source is the whole contents of the file, which is scanned in place
+status_t parseFile(AST* ast, std::string source);
 
 }  // namespace android
\ No newline at end of file
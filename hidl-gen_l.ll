@@ -57,12 +57,15 @@ using token = yy::parser::token;
 
 static std::string gCurrentComment;
 
-#define SCALAR_TYPE(kind)                                        \
-    {                                                            \
-        yylval->type = new ScalarType(ScalarType::kind, *scope); \
-        return token::TYPE;                                      \
+#define SCALAR_TYPE(kind)                                                    \
+    {                                                                        \
+        yylval->type = yyextra->make<ScalarType>(ScalarType::kind, *scope); \
+        return token::TYPE;                                                  \
     }
 
+// the text of the current token, interned in the AST being parsed
+#define TOKEN_TEXT yyextra->intern(std::string_view(yytext, yyleng))
+
 #define YY_DECL int yylex(YYSTYPE* yylval_param, YYLTYPE* yylloc_param,  \
     yyscan_t yyscanner, android::Scope** const scope)
 
@@ -82,6 +85,7 @@ static std::string gCurrentComment;
 %option reentrant
 %option bison-bridge
 %option bison-locations
+%option extra-type="android::AST*"
 
 %x COMMENT_STATE
 %x DOC_COMMENT_STATE
@@ -91,7 +95,7 @@ static std::string gCurrentComment;
 "/**"                       { gCurrentComment.clear(); BEGIN(DOC_COMMENT_STATE); }
 <DOC_COMMENT_STATE>"*/"     {
                                 BEGIN(INITIAL);
-                                yylval->docComment = new DocComment(gCurrentComment);
+                                yylval->docComment = yyextra->make<DocComment>(gCurrentComment);
                                 return token::DOC_COMMENT;
                             }
 <DOC_COMMENT_STATE>[^*\n]*                          { gCurrentComment += yytext; }
@@ -114,9 +118,9 @@ static std::string gCurrentComment;
 "struct"            { return token::STRUCT; }
 "typedef"           { return token::TYPEDEF; }
 "union"             { return token::UNION; }
-"bitfield"          { yylval->templatedType = new BitFieldType(*scope); return token::TEMPLATED; }
-"vec"               { yylval->templatedType = new VectorType(*scope); return token::TEMPLATED; }
-"ref"               { yylval->templatedType = new RefType(*scope); return token::TEMPLATED; }
+"bitfield"          { yylval->templatedType = yyextra->make<BitFieldType>(*scope); return token::TEMPLATED; }
+"vec"               { yylval->templatedType = yyextra->make<VectorType>(*scope); return token::TEMPLATED; }
+"ref"               { yylval->templatedType = yyextra->make<RefType>(*scope); return token::TEMPLATED; }
 "oneway"            { return token::ONEWAY; }
 
 "bool"              { SCALAR_TYPE(KIND_BOOL); }
@@ -131,14 +135,14 @@ static std::string gCurrentComment;
 "float"             { SCALAR_TYPE(KIND_FLOAT); }
 "double"            { SCALAR_TYPE(KIND_DOUBLE); }
 
-"death_recipient"   { yylval->type = new DeathRecipientType(*scope); return token::TYPE; }
-"handle"            { yylval->type = new HandleType(*scope); return token::TYPE; }
-"memory"            { yylval->type = new MemoryType(*scope); return token::TYPE; }
-"pointer"           { yylval->type = new PointerType(*scope); return token::TYPE; }
-"string"            { yylval->type = new StringType(*scope); return token::TYPE; }
+"death_recipient"   { yylval->type = yyextra->make<DeathRecipientType>(*scope); return token::TYPE; }
+"handle"            { yylval->type = yyextra->make<HandleType>(*scope); return token::TYPE; }
+"memory"            { yylval->type = yyextra->make<MemoryType>(*scope); return token::TYPE; }
+"pointer"           { yylval->type = yyextra->make<PointerType>(*scope); return token::TYPE; }
+"string"            { yylval->type = yyextra->make<StringType>(*scope); return token::TYPE; }
 
-"fmq_sync"          { yylval->type = new FmqType("::android::hardware", "MQDescriptorSync", *scope); return token::TEMPLATED; }
-"fmq_unsync"        { yylval->type = new FmqType("::android::hardware", "MQDescriptorUnsync", *scope); return token::TEMPLATED; }
+"fmq_sync"          { yylval->type = yyextra->make<FmqType>("::android::hardware", "MQDescriptorSync", *scope); return token::TEMPLATED; }
+"fmq_unsync"        { yylval->type = yyextra->make<FmqType>("::android::hardware", "MQDescriptorUnsync", *scope); return token::TEMPLATED; }
 
 "("                 { return('('); }
 ")"                 { return(')'); }
@@ -174,22 +178,22 @@ static std::string gCurrentComment;
 "?"                 { return('?'); }
 "@"                 { return('@'); }
 
-{COMPONENT}         { yylval->str = strdup(yytext); return token::IDENTIFIER; }
-{FQNAME}            { yylval->str = strdup(yytext); return token::FQNAME; }
+{COMPONENT}         { yylval->str = TOKEN_TEXT; return token::IDENTIFIER; }
+{FQNAME}            { yylval->str = TOKEN_TEXT; return token::FQNAME; }
 
-0[xX]{H}+{IS}?      { yylval->str = strdup(yytext); return token::INTEGER; }
-0{D}+{IS}?          { yylval->str = strdup(yytext); return token::INTEGER; }
-{D}+{IS}?           { yylval->str = strdup(yytext); return token::INTEGER; }
-L?\"(\\.|[^\\"])*\" { yylval->str = strdup(yytext); return token::STRING_LITERAL; }
+0[xX]{H}+{IS}?      { yylval->str = TOKEN_TEXT; return token::INTEGER; }
+0{D}+{IS}?          { yylval->str = TOKEN_TEXT; return token::INTEGER; }
+{D}+{IS}?           { yylval->str = TOKEN_TEXT; return token::INTEGER; }
+L?\"(\\.|[^\\"])*\" { yylval->str = TOKEN_TEXT; return token::STRING_LITERAL; }
 
-{D}+{E}{FS}?        { yylval->str = strdup(yytext); return token::FLOAT; }
-{D}+\.{E}?{FS}?     { yylval->str = strdup(yytext); return token::FLOAT; }
-{D}*\.{D}+{E}?{FS}? { yylval->str = strdup(yytext); return token::FLOAT; }
+{D}+{E}{FS}?        { yylval->str = TOKEN_TEXT; return token::FLOAT; }
+{D}+\.{E}?{FS}?     { yylval->str = TOKEN_TEXT; return token::FLOAT; }
+{D}*\.{D}+{E}?{FS}? { yylval->str = TOKEN_TEXT; return token::FLOAT; }
 
 \n|\r\n             { yylloc->lines(); }
 [ \t\f\v]           { /* ignore all other whitespace */ }
 
-.                   { yylval->str = strdup(yytext); return token::UNKNOWN; }
+.                   { yylval->str = TOKEN_TEXT; return token::UNKNOWN; }
 
 %%
 
@@ -197,11 +201,13 @@ L?\"(\\.|[^\\"])*\" { yylval->str = strdup(yytext); return token::STRING_LITERAL
 
 namespace android {
 
-status_t parseFile(AST* ast, std::unique_ptr<FILE, std::function<void(FILE *)>> file) {
+status_t parseFile(AST* ast, std::string source) {
     yyscan_t scanner;
-    yylex_init(&scanner);
+    yylex_init_extra(ast, &scanner);
 
-    yyset_in(file.get(), scanner);
+    // flex scans a buffer in place if it ends with two YY_END_OF_BUFFER_CHARs.
+    source.append(2, YY_END_OF_BUFFER_CHAR);
+    yy_scan_buffer(&source[0], source.size(), scanner);
 
     Scope* scopeStack = ast->getRootScope();
     int res = yy::parser(scanner, ast, &scopeStack).parse();
@@ -29,6 +29,24 @@ struct Hash {
     static const Hash &getHash(const std::string &path);
     static void clearHash(const std::string& path);
 
+    // Forgets all hashes and current.txt files read so far, so that changed files are read
+    // again. References returned by getHash before this must no longer be used.
+    static void clearCaches();
+
+    // hash of the file at path as it is now, bypassing the cache used by getHash
+    static std::string hexFileHash(const std::string& path);
+
+    // Reads the file at path into contents, so that it is read only once to be hashed and
+    // parsed. Unless the file was hashed already, getHash returns the hash of what was read.
+    // Returns false if the file can't be read.
+    static bool readFile(const std::string& path, std::string* contents);
+
+    // Keeps the hashes of files in cacheFile, keyed by path, size and modification time, so
+    // that later invocations don't read and hash unchanged files again. Hashes computed since
+    // are written back by saveFileHashCache. An empty cacheFile turns this off.
+    static void setFileHashCache(const std::string& cacheFile);
+    static void saveFileHashCache();
+
     // returns matching hashes of interfaceName in path
     // path is something like hardware/interfaces/current.txt
     // interfaceName is something like android.hardware.foo@1.0::IFoo
@@ -39,15 +57,20 @@ struct Hash {
     static std::string hexString(const std::vector<uint8_t> &hash);
     std::string hexString() const;
 
+    // hash of the file contents, even if the hash has been cleared
+    std::string contentHexString() const;
+
     const std::vector<uint8_t> &raw() const;
     const std::string &getPath() const;
 
 private:
     Hash(const std::string &path);
+    Hash(const std::string& path, const std::vector<uint8_t>& contentHash);
 
     static Hash& getMutableHash(const std::string& path);
 
     const std::string mPath;
+    const std::vector<uint8_t> mContentHash;
     std::vector<uint8_t> mHash;
 };
 
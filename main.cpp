@@ -16,19 +16,31 @@
 
 #include "AST.h"
 #include "Coordinator.h"
+#include "Phase.h"
 #include "Scope.h"
 
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <hidl-hash/Hash.h>
 #include <hidl-util/FQName.h>
 #include <hidl-util/Formatter.h>
 #include <hidl-util/StringHelper.h>
 #include <stdio.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace android;
@@ -44,6 +56,7 @@ enum class GenerationGranularity {
     PER_PACKAGE,  // Files generated for each package
     PER_FILE,     // Files generated for each hal file
     PER_TYPE,     // Files generated for each hal file + each type in HAL files
+    PER_FILE_AND_TYPE,  // Files generated for each hal file, and each type in types.hal
 };
 
 // Represents a file that is generated by an -L option for an FQName
@@ -103,7 +116,10 @@ struct FileGenerator {
             return UNKNOWN_ERROR;
         }
 
-        return mGenerationFunction(out, fqName, coordinator);
+        status_t err = mGenerationFunction(out, fqName, coordinator);
+        if (err != OK) return err;
+
+        return out.close() ? OK : UNKNOWN_ERROR;
     }
 
     // Helper methods for filling out this struct
@@ -112,6 +128,10 @@ struct FileGenerator {
         return names.size() > 0 && names[0] == "types";
     }
     static bool generateForInterfaces(const FQName& fqName) { return !generateForTypes(fqName); }
+    static bool generateForTypesFile(const FQName& fqName) { return fqName.name() == "types"; }
+    static bool generateForSingleTypes(const FQName& fqName) {
+        return generateForTypes(fqName) && !generateForTypesFile(fqName);
+    }
     static bool alwaysGenerate(const FQName&) { return true; }
 };
 
@@ -131,13 +151,16 @@ struct OutputHandler {
     const std::string& name() const { return mKey; }
     const std::string& description() const { return mDescription; }
 
-    status_t generate(const FQName& fqName, const Coordinator* coordinator) const;
+    // Files are generated on up to numJobs threads.
+    status_t generate(const FQName& fqName, const Coordinator* coordinator, size_t numJobs) const;
     status_t validate(const FQName& fqName, const Coordinator* coordinator,
                       const std::string& language) const {
         return mValidate(fqName, coordinator, language);
     }
 
-    status_t writeDepFile(const FQName& fqName, const Coordinator* coordinator) const;
+    // "written" is set to false if this option has no output files to write a depfile for.
+    status_t writeDepFile(const FQName& fqName, const Coordinator* coordinator,
+                          bool* written) const;
 
    private:
     status_t appendTargets(const FQName& fqName, const Coordinator* coordinator,
@@ -200,6 +223,22 @@ status_t OutputHandler::appendTargets(const FQName& fqName, const Coordinator* c
                 if (err != OK) return err;
             }
         } break;
+        case GenerationGranularity::PER_FILE_AND_TYPE: {
+            std::vector<FQName> files;
+            if (fqName.isFullyQualified()) {
+                files.push_back(fqName);
+            } else {
+                status_t err = coordinator->appendPackageInterfacesToVector(fqName, &files);
+                if (err != OK) return err;
+            }
+            for (const FQName& file : files) {
+                targets->push_back(file);
+                if (file.name() != "types") continue;
+
+                status_t err = appendPerTypeTargets(file, coordinator, targets);
+                if (err != OK) return err;
+            }
+        } break;
         default:
             CHECK(!"Should be here");
     }
@@ -207,19 +246,112 @@ status_t OutputHandler::appendTargets(const FQName& fqName, const Coordinator* c
     return OK;
 }
 
-status_t OutputHandler::generate(const FQName& fqName, const Coordinator* coordinator) const {
+// Runs job(0) .. job(count - 1) on up to numThreads threads. Once a job fails, no more jobs
+// are started, and the error of the failed job with the lowest index is returned.
+static status_t runJobs(size_t count, size_t numThreads,
+                        const std::function<status_t(size_t)>& job) {
+    if (numThreads <= 1 || count <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            status_t err = job(i);
+            if (err != OK) return err;
+        }
+        return OK;
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex errorMutex;
+    size_t errorIndex = count;
+    status_t error = OK;
+
+    auto worker = [&] {
+        size_t i;
+        while (!failed && (i = next++) < count) {
+            status_t err = job(i);
+            if (err == OK) continue;
+
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (i < errorIndex) {
+                errorIndex = i;
+                error = err;
+            }
+            failed = true;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::min(numThreads, count); ++i) {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return error;
+}
+
+// Parses everything generating target will use, so that generation jobs find their ASTs in the
+// coordinator's cache instead of waiting on each other to parse them. Errors are left to be
+// reported by generation.
+static void preParseTarget(const FQName& target, const Coordinator* coordinator) {
+    if (target.isFullyQualified()) {
+        coordinator->parse(target.name().find("types.") == 0 ? target.getTypesForPackage()
+                                                             : target);
+        return;
+    }
+
+    std::vector<FQName> packageInterfaces;
+    if (coordinator->appendPackageInterfacesToVector(target, &packageInterfaces) != OK) return;
+    for (const FQName& packageInterface : packageInterfaces) {
+        coordinator->parse(packageInterface);
+    }
+}
+
+status_t OutputHandler::generate(const FQName& fqName, const Coordinator* coordinator,
+                                 size_t numJobs) const {
     std::vector<FQName> targets;
     status_t err = appendTargets(fqName, coordinator, &targets);
     if (err != OK) return err;
 
+    // Output to stdout must not be interleaved.
+    if (mLocation == Coordinator::Location::STANDARD_OUT) {
+        numJobs = 1;
+    }
+
+    std::vector<std::pair<const FQName*, const FileGenerator*>> jobs;
     for (const FQName& fqName : targets) {
+        if (numJobs > 1) {
+            preParseTarget(fqName, coordinator);
+        }
+
         for (const FileGenerator& file : mGenerateFunctions) {
-            status_t err = file.generate(fqName, coordinator, mLocation);
-            if (err != OK) return err;
+            jobs.push_back({&fqName, &file});
         }
     }
 
-    return OK;
+    return runJobs(jobs.size(), numJobs, [&](size_t i) {
+        const FQName& target = *jobs[i].first;
+        const FileGenerator& file = *jobs[i].second;
+
+        ScopedPhase phase(name().c_str());
+        status_t err = file.generate(target, coordinator, mLocation);
+
+        if (err == OK && ScopedPhase::isEnabled()) {
+            phase.addArg("fqName", target.string());
+
+            std::string path;
+            struct stat st;
+            if (mLocation != Coordinator::Location::STANDARD_OUT &&
+                file.getOutputFile(target, coordinator, mLocation, &path) == OK &&
+                !path.empty() && stat(path.c_str(), &st) == 0) {
+                phase.addArg("file", path);
+                phase.addArg("bytes", std::to_string(st.st_size));
+                ScopedPhase::count("bytes written", st.st_size);
+            }
+        }
+
+        return err;
+    });
 }
 
 status_t OutputHandler::appendOutputFiles(const FQName& fqName, const Coordinator* coordinator,
@@ -238,7 +370,10 @@ status_t OutputHandler::appendOutputFiles(const FQName& fqName, const Coordinato
     return OK;
 }
 
-status_t OutputHandler::writeDepFile(const FQName& fqName, const Coordinator* coordinator) const {
+status_t OutputHandler::writeDepFile(const FQName& fqName, const Coordinator* coordinator,
+                                     bool* written) const {
+    *written = false;
+
     std::vector<std::string> outputFiles;
     status_t err = appendOutputFiles(fqName, coordinator, &outputFiles);
     if (err != OK) return err;
@@ -248,6 +383,8 @@ status_t OutputHandler::writeDepFile(const FQName& fqName, const Coordinator* co
         return OK;
     }
 
+    *written = true;
+
     // Depfiles in Android for genrules should be for the 'main file'. Because hidl-gen doesn't have
     // a main file for most targets, we are just outputting a depfile for one single file only.
     const std::string forFile = outputFiles[0];
@@ -273,6 +410,23 @@ static FileGenerator::GenerationFunction astGenerationFunction(void (AST::*gener
     };
 }
 
+// Like astGenerationFunction, but for a single type of types.hal: fqName is types.<Type>.
+static FileGenerator::GenerationFunction typeGenerationFunction(
+        void (AST::*generate)(Formatter&, const std::string&) const) {
+    return [generate](Formatter& out, const FQName& fqName,
+                      const Coordinator* coordinator) -> status_t {
+        AST* ast = coordinator->parse(fqName.getTypesForPackage());
+        if (ast == nullptr) {
+            fprintf(stderr, "ERROR: Could not parse %s. Aborting.\n", fqName.string().c_str());
+            return UNKNOWN_ERROR;
+        }
+
+        (ast->*generate)(out, fqName.name().substr(strlen("types.")));
+
+        return OK;
+    };
+}
+
 // Common pattern: single file for package or standard out
 static FileGenerator singleFileGenerator(
     const std::string& fileName, const FileGenerator::GenerationFunction& generationFunction) {
@@ -749,9 +903,10 @@ bool validateForSource(const FQName& fqName, const Coordinator* coordinator,
             return true;
         }
 
-        if (language != "java" || name.find("types.") != 0) {
-            // When generating java sources for "types.hal", output can be
-            // constrained to just one of the top-level types declared
+        if ((language != "java" && language != "c++-headers-split") ||
+            name.find("types.") != 0) {
+            // When generating java sources or split c++ headers for "types.hal",
+            // output can be constrained to just one of the top-level types declared
             // by using the extended syntax
             // android.hardware.Foo@1.0::types.TopLevelTypeName.
             // In all other cases (different language, not 'types') the dot
@@ -880,7 +1035,9 @@ static status_t generateHashOutput(Formatter& out, const FQName& fqName,
         return UNKNOWN_ERROR;
     }
 
-    out << Hash::getHash(ast->getFilename()).hexString() << " " << fqName.string() << "\n";
+    // In -s mode, an earlier invocation may have cleared the hash of an unfrozen interface.
+    out << Hash::getHash(ast->getFilename()).contentHexString() << " " << fqName.string()
+        << "\n";
 
     return OK;
 }
@@ -925,6 +1082,59 @@ static const std::vector<FileGenerator> kCppHeaderFormats = {
     },
 };
 
+// Same as kCppHeaderFormats, except that types.hal gets a header per type.
+static const std::vector<FileGenerator> kCppSplitHeaderFormats = {
+    {
+        FileGenerator::generateForInterfaces,
+        [](const FQName& fqName) { return fqName.name() + ".h"; },
+        astGenerationFunction(&AST::generateInterfaceHeader),
+    },
+    {
+        FileGenerator::generateForInterfaces,
+        [](const FQName& fqName) { return fqName.getInterfaceHwName() + ".h"; },
+        astGenerationFunction(&AST::generateHwBinderHeader),
+    },
+    {
+        FileGenerator::generateForTypesFile,
+        [](const FQName&) { return "types.h"; },
+        astGenerationFunction(&AST::generateTypesUmbrellaHeader),
+    },
+    {
+        FileGenerator::generateForTypesFile,
+        [](const FQName&) { return "hwtypes.h"; },
+        astGenerationFunction(&AST::generateHwTypesUmbrellaHeader),
+    },
+    {
+        FileGenerator::generateForSingleTypes,
+        [](const FQName& fqName) {
+            return "types/" + StringHelper::LTrim(fqName.name(), "types.") + ".h";
+        },
+        typeGenerationFunction(&AST::generateTypeHeader),
+    },
+    {
+        FileGenerator::generateForSingleTypes,
+        [](const FQName& fqName) {
+            return "types/hw" + StringHelper::LTrim(fqName.name(), "types.") + ".h";
+        },
+        typeGenerationFunction(&AST::generateHwTypeHeader),
+    },
+    {
+        FileGenerator::generateForInterfaces,
+        [](const FQName& fqName) { return fqName.getInterfaceStubName() + ".h"; },
+        astGenerationFunction(&AST::generateStubHeader),
+    },
+    {
+        FileGenerator::generateForInterfaces,
+        [](const FQName& fqName) { return fqName.getInterfaceProxyName() + ".h"; },
+        astGenerationFunction(&AST::generateProxyHeader),
+    },
+    {
+        FileGenerator::generateForInterfaces,
+        [](const FQName& fqName) { return fqName.getInterfacePassthroughName() + ".h"; },
+        astGenerationFunction(&AST::generatePassthroughHeader),
+    },
+};
+
 static const std::vector<FileGenerator> kCppSourceFormats = {
     {
         FileGenerator::alwaysGenerate,
@@ -1005,6 +1215,15 @@ static const std::vector<OutputHandler> kFormats = {
         validateForSource,
         kCppHeaderFormats,
     },
+    {
+        "c++-headers-split",
+        "(internal) Like c++-headers, but with a header per type of types.hal under types/.",
+        OutputMode::NEEDS_DIR,
+        Coordinator::Location::GEN_OUTPUT,
+        GenerationGranularity::PER_FILE_AND_TYPE,
+        validateForSource,
+        kCppSplitHeaderFormats,
+    },
     {
         "c++-sources",
         "(internal) Generates C++ sources for interface files for talking to HIDL interfaces.",
@@ -1177,17 +1396,32 @@ static const std::vector<OutputHandler> kFormats = {
 };
 // clang-format on
 
+// Printed on a line of its own, followed by the exit code, after each invocation in -s mode.
+static const char* const kServeDoneMarker = "##hidl-gen-done";
+
 static void usage(const char *me) {
     fprintf(stderr,
-            "usage: %s [-p <root path>] -o <output path> -L <language> [-O <owner>] (-r <interface "
-            "root>)+ [-v] [-d <depfile>] FQNAME...\n\n",
+            "usage: %s [-p <root path>] -o <output path> (-L <language>[:<output path>])+ [-O <owner>] "
+            "(-r <interface root>)+ [-v] [-t] [-P] [-S] [-d <depfile>] [-c <cache dir>] "
+            "[-j <jobs>] [-T <trace file>] FQNAME...\n\n",
             me);
 
     fprintf(stderr,
             "Process FQNAME, PACKAGE(.SUBPACKAGE)*@[0-9]+.[0-9]+(::TYPE)?, to create output.\n\n");
 
+    fprintf(stderr, "usage: %s -s\n\n", me);
+    fprintf(stderr,
+            "Reads invocations from standard in, one per line with the arguments above, and keeps\n"
+            "parsed files in memory between them. \"%s <exit code>\" is printed to standard out\n"
+            "after each one.\n\n",
+            kServeDoneMarker);
+
     fprintf(stderr, "         -h: Prints this menu.\n");
-    fprintf(stderr, "         -L <language>: The following options are available:\n");
+    fprintf(stderr,
+            "         -L <language>[:<output path>]: May be given more than once to generate\n"
+            "            several languages from a single parse. Each language is written to its\n"
+            "            own output path if one is given, or to -o otherwise. The following\n"
+            "            options are available:\n");
     for (auto& e : kFormats) {
         fprintf(stderr, "            %-16s: %s\n", e.name().c_str(), e.description().c_str());
     }
@@ -1196,7 +1430,164 @@ static void usage(const char *me) {
     fprintf(stderr, "         -p <root path>: Android build root, defaults to $ANDROID_BUILD_TOP or pwd.\n");
     fprintf(stderr, "         -r <package:path root>: E.g., android.hardware:hardware/interfaces.\n");
     fprintf(stderr, "         -v: verbose output.\n");
+    fprintf(stderr,
+            "         -t: defines toString() of structs, unions and enums in the C++ sources\n"
+            "            instead of inline in the headers. Pass it for both of a package.\n");
+    fprintf(stderr,
+            "         -P: C++ proxies of methods taking only scalars reuse the data Parcel of\n"
+            "            the calling thread across calls.\n");
+    fprintf(stderr,
+            "         -S: C++ proxies and stubs count calls, errors and latencies per method,\n"
+            "            which the default debug() prints when given \"--stats\".\n");
     fprintf(stderr, "         -d <depfile>: location of depfile to write to.\n");
+    fprintf(stderr,
+            "         -c <cache dir>: location to keep package validation results in, so that\n"
+            "            later runs can skip validating packages which haven't changed.\n");
+    fprintf(stderr, "         -j <jobs>: number of files to generate in parallel, defaults to 1.\n");
+    fprintf(stderr,
+            "         -T <trace file>: writes the time spent parsing, validating and generating\n"
+            "            each file as a Chrome trace (chrome://tracing, ui.perfetto.dev).\n");
+}
+
+// Writes the phases and counters reported through ScopedPhase in the Chrome trace event format.
+struct TraceWriter : public ScopedPhase::Listener {
+    explicit TraceWriter(const std::string& path)
+        : mPath(path), mStart(std::chrono::steady_clock::now()) {}
+
+    void onPhaseBegin(const ScopedPhase& phase) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        appendEventLocked(phase.name(), 'B');
+        mEvents += "}";
+    }
+
+    void onPhaseEnd(const ScopedPhase& phase) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        appendEventLocked(phase.name(), 'E');
+        mEvents += ",\"args\":{";
+        bool first = true;
+        for (const auto& arg : phase.args()) {
+            if (!first) mEvents += ",";
+            first = false;
+            mEvents += "\"" + escape(arg.first) + "\":\"" + escape(arg.second) + "\"";
+        }
+        mEvents += "}}";
+    }
+
+    void onCounter(const char* name, int64_t delta) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        int64_t& value = mCounters[name];
+        value += delta;
+        appendEventLocked(name, 'C');
+        mEvents += ",\"args\":{\"value\":" + std::to_string(value) + "}}";
+    }
+
+    status_t write() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        FILE* file = fopen(mPath.c_str(), "w");
+        if (file == nullptr) {
+            fprintf(stderr, "ERROR: Could not open trace file %s.\n", mPath.c_str());
+            return UNKNOWN_ERROR;
+        }
+        fprintf(file, "{\"traceEvents\":[\n%s\n]}\n", mEvents.c_str());
+        if (fclose(file) != 0) {
+            fprintf(stderr, "ERROR: Could not write trace file %s.\n", mPath.c_str());
+            return UNKNOWN_ERROR;
+        }
+        return OK;
+    }
+
+   private:
+    // Starts an event without closing it, so that arguments can follow.
+    void appendEventLocked(const char* name, char phase) {
+        static std::atomic<size_t> sNextThreadId{1};
+        static thread_local size_t sThreadId = sNextThreadId++;
+
+        const double micros = std::chrono::duration<double, std::micro>(
+                                      std::chrono::steady_clock::now() - mStart)
+                                      .count();
+
+        if (!mEvents.empty()) mEvents += ",\n";
+        mEvents += "{\"name\":\"" + escape(name) + "\",\"ph\":\"" + phase +
+                   "\",\"pid\":1,\"tid\":" + std::to_string(sThreadId) +
+                   ",\"ts\":" + std::to_string(micros);
+    }
+
+    static std::string escape(const std::string& in) {
+        std::string out;
+        for (char c : in) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+    const std::string mPath;
+    const std::chrono::steady_clock::time_point mStart;
+
+    mutable std::mutex mMutex;
+    std::string mEvents;
+    std::map<std::string, int64_t> mCounters;
+};
+
+// Installs a TraceWriter for as long as it is in scope.
+struct ScopedTraceWriter {
+    explicit ScopedTraceWriter(TraceWriter* writer) {
+        ScopedPhase::setListener(writer);
+    }
+    ~ScopedTraceWriter() { ScopedPhase::setListener(nullptr); }
+};
+
+// A -L option along with the directory (or file) its output is written to.
+struct OutputTarget {
+    const OutputHandler* handler;
+    std::string outputPath;
+};
+
+static status_t resolveOutputPath(const char* me, const Coordinator& coordinator,
+                                  OutputTarget* target) {
+    std::string& outputPath = target->outputPath;
+
+    switch (target->handler->mOutputMode) {
+        case OutputMode::NEEDS_DIR:
+        case OutputMode::NEEDS_FILE: {
+            if (outputPath.empty()) {
+                usage(me);
+                return BAD_VALUE;
+            }
+
+            if (target->handler->mOutputMode == OutputMode::NEEDS_DIR) {
+                if (outputPath.back() != '/') {
+                    outputPath += "/";
+                }
+            }
+            break;
+        }
+        case OutputMode::NEEDS_SRC: {
+            if (outputPath.empty()) {
+                outputPath = coordinator.getRootPath();
+            }
+            if (outputPath.back() != '/') {
+                outputPath += "/";
+            }
+
+            break;
+        }
+
+        default:
+            outputPath.clear();  // Unused.
+            break;
+    }
+
+    return OK;
 }
 
 // hidl is intentionally leaky. Turn off LeakSanitizer by default.
@@ -1204,24 +1595,28 @@ extern "C" const char *__asan_default_options() {
     return "detect_leaks=0";
 }
 
-int main(int argc, char **argv) {
+// Runs a single invocation of hidl-gen with the given arguments, returning its exit code.
+static int hidlGen(int argc, char** argv, Coordinator* coordinatorPtr) {
+    Coordinator& coordinator = *coordinatorPtr;
+
     const char *me = argv[0];
     if (argc == 1) {
         usage(me);
-        exit(1);
+        return 1;
     }
 
-    const OutputHandler* outputFormat = nullptr;
-    Coordinator coordinator;
+    std::vector<OutputTarget> outputTargets;
     std::string outputPath;
+    std::string tracePath;
+    size_t numJobs = 1;
 
     int res;
-    while ((res = getopt(argc, argv, "hp:o:O:r:L:vd:")) >= 0) {
+    while ((res = getopt(argc, argv, "hp:o:O:r:L:vtPSd:c:j:T:")) >= 0) {
         switch (res) {
             case 'p': {
                 if (!coordinator.getRootPath().empty()) {
                     fprintf(stderr, "ERROR: -p <root path> can only be specified once.\n");
-                    exit(1);
+                    return 1;
                 }
                 coordinator.setRootPath(optarg);
                 break;
@@ -1232,15 +1627,52 @@ int main(int argc, char **argv) {
                 break;
             }
 
+            case 't': {
+                coordinator.setOutOfLineToString(true);
+                break;
+            }
+
+            case 'P': {
+                coordinator.setReuseParcels(true);
+                break;
+            }
+
+            case 'S': {
+                coordinator.setMethodStats(true);
+                break;
+            }
+
             case 'd': {
                 coordinator.setDepFile(optarg);
                 break;
             }
 
+            case 'c': {
+                coordinator.setCacheDir(optarg);
+                break;
+            }
+
+            case 'j': {
+                if (!android::base::ParseUint(optarg, &numJobs) || numJobs == 0) {
+                    fprintf(stderr, "ERROR: -j expects a positive number of jobs: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+
+            case 'T': {
+                if (!tracePath.empty()) {
+                    fprintf(stderr, "ERROR: -T <trace file> can only be specified once.\n");
+                    return 1;
+                }
+                tracePath = optarg;
+                break;
+            }
+
             case 'o': {
                 if (!outputPath.empty()) {
                     fprintf(stderr, "ERROR: -o <output path> can only be specified once.\n");
-                    exit(1);
+                    return 1;
                 }
                 outputPath = optarg;
                 break;
@@ -1249,7 +1681,7 @@ int main(int argc, char **argv) {
             case 'O': {
                 if (!coordinator.getOwner().empty()) {
                     fprintf(stderr, "ERROR: -O <owner> can only be specified once.\n");
-                    exit(1);
+                    return 1;
                 }
                 coordinator.setOwner(optarg);
                 break;
@@ -1260,7 +1692,7 @@ int main(int argc, char **argv) {
                 auto index = val.find_first_of(':');
                 if (index == std::string::npos) {
                     fprintf(stderr, "ERROR: -r option must contain ':': %s\n", val.c_str());
-                    exit(1);
+                    return 1;
                 }
 
                 auto root = val.substr(0, index);
@@ -1270,21 +1702,25 @@ int main(int argc, char **argv) {
                 status_t err = coordinator.addPackagePath(root, path, &error);
                 if (err != OK) {
                     fprintf(stderr, "%s\n", error.c_str());
-                    exit(1);
+                    return 1;
                 }
 
                 break;
             }
 
             case 'L': {
-                if (outputFormat != nullptr) {
-                    fprintf(stderr,
-                            "ERROR: only one -L option allowed. \"%s\" already specified.\n",
-                            outputFormat->name().c_str());
-                    exit(1);
+                std::string language(optarg);
+                std::string languageOutputPath;
+
+                auto index = language.find_first_of(':');
+                if (index != std::string::npos) {
+                    languageOutputPath = language.substr(index + 1);
+                    language = language.substr(0, index);
                 }
+
+                const OutputHandler* outputFormat = nullptr;
                 for (auto& e : kFormats) {
-                    if (e.name() == optarg) {
+                    if (e.name() == language) {
                         outputFormat = &e;
                         break;
                     }
@@ -1292,9 +1728,18 @@ int main(int argc, char **argv) {
                 if (outputFormat == nullptr) {
                     fprintf(stderr,
                             "ERROR: unrecognized -L option: \"%s\".\n",
-                            optarg);
-                    exit(1);
+                            language.c_str());
+                    return 1;
+                }
+                for (const OutputTarget& target : outputTargets) {
+                    if (target.handler == outputFormat) {
+                        fprintf(stderr, "ERROR: -L option \"%s\" specified more than once.\n",
+                                language.c_str());
+                        return 1;
+                    }
                 }
+
+                outputTargets.push_back({outputFormat, languageOutputPath});
                 break;
             }
 
@@ -1302,7 +1747,7 @@ int main(int argc, char **argv) {
             case 'h':
             default: {
                 usage(me);
-                exit(1);
+                return 1;
                 break;
             }
         }
@@ -1315,10 +1760,22 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (outputFormat == nullptr) {
+    if (outputTargets.empty()) {
         fprintf(stderr,
             "ERROR: no -L option provided.\n");
-        exit(1);
+        return 1;
+    }
+
+    if (outputTargets.size() > 1) {
+        for (const OutputTarget& target : outputTargets) {
+            // -Lhash parses without enforcing hashes, while every other language enforces them
+            // and clears the hashes of unfrozen interfaces. Since ASTs and enforcement results
+            // are shared between languages, the two cannot be mixed.
+            if (target.handler->name() == "hash") {
+                fprintf(stderr, "ERROR: -Lhash cannot be combined with other -L options.\n");
+                return 1;
+            }
+        }
     }
 
     argc -= optind;
@@ -1327,56 +1784,44 @@ int main(int argc, char **argv) {
     if (argc == 0) {
         fprintf(stderr, "ERROR: no fqname specified.\n");
         usage(me);
-        exit(1);
+        return 1;
     }
 
     // Valid options are now in argv[0] .. argv[argc - 1].
 
-    switch (outputFormat->mOutputMode) {
-        case OutputMode::NEEDS_DIR:
-        case OutputMode::NEEDS_FILE: {
-            if (outputPath.empty()) {
-                usage(me);
-                exit(1);
-            }
-
-            if (outputFormat->mOutputMode == OutputMode::NEEDS_DIR) {
-                if (outputPath.back() != '/') {
-                    outputPath += "/";
-                }
-            }
-            break;
-        }
-        case OutputMode::NEEDS_SRC: {
-            if (outputPath.empty()) {
-                outputPath = coordinator.getRootPath();
-            }
-            if (outputPath.back() != '/') {
-                outputPath += "/";
-            }
-
-            break;
+    for (OutputTarget& target : outputTargets) {
+        if (target.outputPath.empty()) {
+            target.outputPath = outputPath;
         }
 
-        default:
-            outputPath.clear();  // Unused.
-            break;
+        status_t err = resolveOutputPath(me, coordinator, &target);
+        if (err != OK) return 1;
     }
 
-    coordinator.setOutputPath(outputPath);
+    std::unique_ptr<TraceWriter> traceWriter;
+    if (!tracePath.empty()) {
+        traceWriter = std::make_unique<TraceWriter>(tracePath);
+    }
+    ScopedTraceWriter scopedTraceWriter(traceWriter.get());
 
     coordinator.addDefaultPackagePath("android.hardware", "hardware/interfaces");
     coordinator.addDefaultPackagePath("android.hidl", "system/libhidl/transport");
     coordinator.addDefaultPackagePath("android.frameworks", "frameworks/hardware/interfaces");
     coordinator.addDefaultPackagePath("android.system", "system/hardware/interfaces");
 
+    coordinator.dropStaleCaches();
+
+    std::vector<FQName> fqNames;
     for (int i = 0; i < argc; ++i) {
         FQName fqName;
         if (!FQName::parse(argv[i], &fqName)) {
             fprintf(stderr, "ERROR: Invalid fully-qualified name as argument: %s.\n", argv[i]);
-            exit(1);
+            return 1;
         }
+        fqNames.push_back(fqName);
+    }
 
+    for (const FQName& fqName : fqNames) {
         // Dump extra verbose output
         if (coordinator.isVerbose()) {
             status_t err =
@@ -1384,18 +1829,95 @@ int main(int argc, char **argv) {
             if (err != OK) return err;
         }
 
-        if (!outputFormat->validate(fqName, &coordinator, outputFormat->name())) {
-            fprintf(stderr,
-                    "ERROR: output handler failed.\n");
-            exit(1);
+        // The coordinator caches every AST it parses, so each file is only parsed and
+        // validated once no matter how many languages are generated from it.
+        for (const OutputTarget& target : outputTargets) {
+            const OutputHandler* outputFormat = target.handler;
+            coordinator.setOutputPath(target.outputPath);
+
+            if (!outputFormat->validate(fqName, &coordinator, outputFormat->name())) {
+                fprintf(stderr,
+                        "ERROR: output handler failed.\n");
+                return 1;
+            }
+
+            status_t err = outputFormat->generate(fqName, &coordinator, numJobs);
+            if (err != OK) return 1;
+        }
+    }
+
+    // A single depfile is written for all languages. It lists every file read while generating
+    // any of them, for the main output of the first language which has one.
+    for (const OutputTarget& target : outputTargets) {
+        coordinator.setOutputPath(target.outputPath);
+
+        bool written;
+        status_t err = target.handler->writeDepFile(fqNames.back(), &coordinator, &written);
+        if (err != OK) return 1;
+        if (written) break;
+    }
+
+    if (traceWriter != nullptr && traceWriter->write() != OK) return 1;
+
+    coordinator.reportEnforcementCacheHits();
+    if (coordinator.isVerbose()) {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+            const long peakRssKiB = usage.ru_maxrss / 1024;  // in bytes on Mac
+#else
+            const long peakRssKiB = usage.ru_maxrss;
+#endif
+            fprintf(stderr, "VERBOSE: peak RSS %ld KiB\n", peakRssKiB);
         }
+    }
+    Hash::saveFileHashCache();
+
+    return 0;
+}
+
+// Runs invocations read from stdin, one per line of whitespace separated arguments. Parsed
+// files are kept between invocations as long as they don't change.
+static int serve(char* me) {
+    Coordinator coordinator;
+    coordinator.setResident(true);
 
-        status_t err = outputFormat->generate(fqName, &coordinator);
-        if (err != OK) exit(1);
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream lineStream(line);
+        std::vector<std::string> args{std::istream_iterator<std::string>(lineStream),
+                                      std::istream_iterator<std::string>()};
 
-        err = outputFormat->writeDepFile(fqName, &coordinator);
-        if (err != OK) exit(1);
+        std::vector<char*> argv = {me};
+        for (std::string& arg : args) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+
+        coordinator.clearOptions();
+        // makes getopt start over
+#ifdef __GLIBC__
+        optind = 0;  // glibc only resets its state for 0
+#else
+        optind = 1;
+        optreset = 1;
+#endif
+
+        int res = hidlGen(argv.size() - 1, argv.data(), &coordinator);
+
+        fflush(stderr);
+        printf("%s %d\n", kServeDoneMarker, res);
+        fflush(stdout);
     }
 
     return 0;
 }
+
+int main(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], "-s") == 0) {
+        return serve(argv[0]);
+    }
+
+    Coordinator coordinator;
+    return hidlGen(argc, argv, &coordinator);
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Measures the cost of the code generated for proxies and stubs. BpHwBenchmark
+// talks to a BnHwBenchmark in the same process, so each call runs the generated
+// marshalling and unmarshalling code against a real Parcel without going
+// through the binder driver.
+//
+// The reply of a local transaction refers to the buffers handed to _hidl_cb
+// rather than to a kernel copy of them, so the implementation below only ever
+// passes its arguments back. Those stay alive in the caller's frame.
+//
+// hidl_marshalling_benchmark_reuse_parcels runs the same benchmarks against
+// code generated with -P. Compare the allocs/call of the two.
+
+#include <dlfcn.h>
+#include <unistd.h>
+#include <atomic>
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <cutils/ashmem.h>
+#include <fmq/MessageQueue.h>
+#include <hidl/tests/benchmark/1.0/BnHwBenchmark.h>
+#include <hidl/tests/benchmark/1.0/BpHwBenchmark.h>
+
+using ::android::sp;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_memory;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::kSynchronizedReadWrite;
+using ::android::hardware::MessageQueue;
+using ::android::hardware::MQDescriptorSync;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::hidl::tests::benchmark::V1_0::BnHwBenchmark;
+using ::hidl::tests::benchmark::V1_0::BpHwBenchmark;
+using ::hidl::tests::benchmark::V1_0::IBenchmark;
+using ::hidl::tests::benchmark::V1_0::Inner;
+using ::hidl::tests::benchmark::V1_0::Matrix;
+using ::hidl::tests::benchmark::V1_0::Outer;
+using ::hidl::tests::benchmark::V1_0::Variant;
+
+// Allocations are counted where libc makes them, since Parcel buffers are
+// allocated with malloc and realloc rather than operator new.
+static std::atomic<size_t> gAllocations{0};
+
+template <typename F>
+static F libcFunction(const char* name) {
+    return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+extern "C" void* malloc(size_t size) {
+    static auto libcMalloc = libcFunction<void* (*)(size_t)>("malloc");
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return libcMalloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    static auto libcCalloc = libcFunction<void* (*)(size_t, size_t)>("calloc");
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return libcCalloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    static auto libcRealloc = libcFunction<void* (*)(void*, size_t)>("realloc");
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    return libcRealloc(ptr, size);
+}
+
+struct Benchmark : public IBenchmark {
+    Return<void> echoScalars(uint32_t a, int64_t b, bool c, uint8_t d, double e,
+                             echoScalars_cb _hidl_cb) override {
+        _hidl_cb(a, b, c, d, e);
+        return Void();
+    }
+    Return<void> echoString(const hidl_string& s, echoString_cb _hidl_cb) override {
+        _hidl_cb(s);
+        return Void();
+    }
+    Return<void> echoBytes(const hidl_vec<uint8_t>& data, echoBytes_cb _hidl_cb) override {
+        _hidl_cb(data);
+        return Void();
+    }
+    Return<void> echoNested(const hidl_vec<Outer>& data, echoNested_cb _hidl_cb) override {
+        _hidl_cb(data);
+        return Void();
+    }
+    Return<void> echoMatrix(const Matrix& m, echoMatrix_cb _hidl_cb) override {
+        _hidl_cb(m);
+        return Void();
+    }
+    Return<void> echoVariant(const Variant& v, echoVariant_cb _hidl_cb) override {
+        _hidl_cb(v);
+        return Void();
+    }
+    Return<void> echoHandle(const hidl_handle& h, echoHandle_cb _hidl_cb) override {
+        _hidl_cb(h);
+        return Void();
+    }
+    Return<void> echoMemory(const hidl_memory& m, echoMemory_cb _hidl_cb) override {
+        _hidl_cb(m);
+        return Void();
+    }
+    Return<void> echoQueue(const MQDescriptorSync<uint8_t>& q, echoQueue_cb _hidl_cb) override {
+        _hidl_cb(q);
+        return Void();
+    }
+};
+
+static sp<IBenchmark> getProxy() {
+    static sp<IBenchmark> proxy = new BpHwBenchmark(new BnHwBenchmark(new Benchmark()));
+    return proxy;
+}
+
+// Runs call once per iteration and reports the heap allocations it makes, and,
+// if bytesPerCall is non-zero, the payload throughput in each direction.
+template <typename F>
+static void runCalls(benchmark::State& state, size_t bytesPerCall, F call) {
+    sp<IBenchmark> proxy = getProxy();
+    size_t allocations = 0;
+
+    while (state.KeepRunning()) {
+        size_t before = gAllocations.load(std::memory_order_relaxed);
+        CHECK(call(proxy).isOk());
+        allocations += gAllocations.load(std::memory_order_relaxed) - before;
+    }
+
+    state.counters["allocs/call"] =
+            benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+    if (bytesPerCall > 0) {
+        state.SetBytesProcessed(state.iterations() * bytesPerCall);
+    }
+}
+
+static void BM_echoScalars(benchmark::State& state) {
+    runCalls(state, 0, [](const sp<IBenchmark>& proxy) {
+        return proxy->echoScalars(1, 2, true, 3, 4.0, [](auto...) {});
+    });
+}
+BENCHMARK(BM_echoScalars);
+
+static void BM_echoString(benchmark::State& state) {
+    hidl_string s(std::string(state.range(0), 'x'));
+    runCalls(state, s.size(), [&](const sp<IBenchmark>& proxy) {
+        return proxy->echoString(s, [](const auto&) {});
+    });
+}
+BENCHMARK(BM_echoString)->Range(8, 8 << 10);
+
+static void BM_echoBytes(benchmark::State& state) {
+    hidl_vec<uint8_t> data;
+    data.resize(state.range(0));
+    runCalls(state, data.size(), [&](const sp<IBenchmark>& proxy) {
+        return proxy->echoBytes(data, [](const auto&) {});
+    });
+}
+BENCHMARK(BM_echoBytes)->Range(8, 64 << 10);
+
+// range(0) outer elements, each holding range(1) inner vectors of 64 bytes.
+static void BM_echoNested(benchmark::State& state) {
+    hidl_vec<Outer> data;
+    data.resize(state.range(0));
+    for (Outer& outer : data) {
+        outer.name = "outer";
+        outer.inners.resize(state.range(1));
+        for (Inner& inner : outer.inners) {
+            inner.data.resize(64);
+        }
+    }
+    runCalls(state, data.size() * state.range(1) * 64, [&](const sp<IBenchmark>& proxy) {
+        return proxy->echoNested(data, [](const auto&) {});
+    });
+}
+BENCHMARK(BM_echoNested)->Ranges({{1, 64}, {1, 64}});
+
+static void BM_echoMatrix(benchmark::State& state) {
+    Matrix m{};
+    runCalls(state, sizeof(m), [&](const sp<IBenchmark>& proxy) {
+        return proxy->echoMatrix(m, [](const auto&) {});
+    });
+}
+BENCHMARK(BM_echoMatrix);
+
+static void BM_echoVariant(benchmark::State& state) {
+    Variant v{};
+    v.u64 = 42;
+    runCalls(state, sizeof(v), [&](const sp<IBenchmark>& proxy) {
+        return proxy->echoVariant(v, [](const auto&) {});
+    });
+}
+BENCHMARK(BM_echoVariant);
+
+static void BM_echoHandle(benchmark::State& state) {
+    native_handle_t* nh = native_handle_create(1 /* numFds */, 0 /* numInts */);
+    nh->data[0] = dup(STDOUT_FILENO);
+    hidl_handle h;
+    h.setTo(nh, true /* shouldOwn */);
+    runCalls(state, 0, [&](const sp<IBenchmark>& proxy) {
+        return proxy->echoHandle(h, [](const auto&) {});
+    });
+}
+BENCHMARK(BM_echoHandle);
+
+static void BM_echoMemory(benchmark::State& state) {
+    constexpr size_t kSize = 4096;
+    native_handle_t* nh = native_handle_create(1 /* numFds */, 0 /* numInts */);
+    nh->data[0] = ashmem_create_region("hidl_benchmark", kSize);
+    CHECK(nh->data[0] >= 0);
+    hidl_memory m("ashmem", nh, kSize);
+    runCalls(state, 0, [&](const sp<IBenchmark>& proxy) {
+        return proxy->echoMemory(m, [](const auto&) {});
+    });
+    native_handle_close(nh);
+    native_handle_delete(nh);
+}
+BENCHMARK(BM_echoMemory);
+
+static void BM_echoQueue(benchmark::State& state) {
+    MessageQueue<uint8_t, kSynchronizedReadWrite> queue(1024);
+    CHECK(queue.isValid());
+    runCalls(state, 0, [&](const sp<IBenchmark>& proxy) {
+        return proxy->echoQueue(*queue.getDesc(), [](const auto&) {});
+    });
+}
+BENCHMARK(BM_echoQueue);
+
+// Alternates between a method taking only scalars, which builds with -P give
+// the Parcel of the thread, and methods writing embedded strings, vectors and
+// handles, which always get a Parcel of their own. Checks every reply, so that
+// state left behind in a reused Parcel would show up.
+static void BM_echoMixed(benchmark::State& state) {
+    hidl_vec<Outer> nested;
+    nested.resize(4);
+    for (size_t i = 0; i < nested.size(); ++i) {
+        nested[i].name = "outer " + std::to_string(i);
+        nested[i].inners.resize(2);
+        for (Inner& inner : nested[i].inners) {
+            inner.data.resize(16);
+            for (uint8_t& byte : inner.data) {
+                byte = i;
+            }
+            inner.tag = i;
+        }
+    }
+    native_handle_t* nh = native_handle_create(1 /* numFds */, 1 /* numInts */);
+    nh->data[0] = dup(STDOUT_FILENO);
+    nh->data[1] = 42;
+    hidl_handle h;
+    h.setTo(nh, true /* shouldOwn */);
+
+    runCalls(state, 0, [&](const sp<IBenchmark>& proxy) {
+        Return<void> scalars = proxy->echoScalars(
+                1, 2, true, 3, 4.0, [](uint32_t a, int64_t b, bool c, uint8_t d, double e) {
+                    CHECK(a == 1 && b == 2 && c && d == 3 && e == 4.0);
+                });
+        if (!scalars.isOk()) return scalars;
+
+        Return<void> vectors = proxy->echoNested(
+                nested, [&](const hidl_vec<Outer>& rdata) { CHECK(rdata == nested); });
+        if (!vectors.isOk()) return vectors;
+
+        Return<void> strings = proxy->echoString(
+                nested[1].name, [&](const hidl_string& rs) { CHECK(rs == nested[1].name); });
+        if (!strings.isOk()) return strings;
+
+        return proxy->echoHandle(h, [](const hidl_handle& rh) {
+            CHECK(rh->numFds == 1 && rh->numInts == 1 && rh->data[1] == 42);
+        });
+    });
+}
+BENCHMARK(BM_echoMixed);
+
+BENCHMARK_MAIN();
@@ -1157,6 +1157,27 @@ TEST_F(HidlTest, FooCallMeTest) {
     });
 }
 
+TEST_F(HidlTest, FooCallMeRepeatedTest) {
+    if (!gHidlEnvironment->enableDelayMeasurementTests) {
+        return;
+    }
+    // Proxies start the threadpool once, on the first call passing an interface.
+    // Callbacks passed on later calls, which skip that, must be serviced as well.
+    // That the first call starts it is checked by hidl_thread_pool_test, since the
+    // threadpool of this process has already been started by the tests above.
+    for (size_t i = 0; i < 2; ++i) {
+        sp<IFooCallback> fooCb = new FooCallback();
+        EXPECT_OK(foo->callMe(fooCb));
+        fooCb->reportResults(3 * DELAY_NS + TOLERANCE_NS,
+                [&](int64_t /* timeLeftNs */,
+                    const hidl_array<IFooCallback::InvokeInfo, 3> &invokeResults) {
+            EXPECT_TRUE(invokeResults[0].invoked) << "call " << i;
+            EXPECT_TRUE(invokeResults[1].invoked) << "call " << i;
+            EXPECT_TRUE(invokeResults[2].invoked) << "call " << i;
+        });
+    }
+}
+
 
 
 TEST_F(HidlTest, FooUseAnEnumTest) {
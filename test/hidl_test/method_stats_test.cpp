@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs the proxy and stub of hidl.tests.benchmark@1.0 generated with -S (see
+// Android.bp) and checks what debug() prints for "--stats". As in
+// hidl_marshalling_benchmark, BpHwBenchmark talks to a BnHwBenchmark in the
+// same process, so the stats of both sides end up in the same dump.
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <cutils/native_handle.h>
+#include <gtest/gtest.h>
+#include <hidl/tests/benchmark/1.0/BnHwBenchmark.h>
+#include <hidl/tests/benchmark/1.0/BpHwBenchmark.h>
+#include <hwbinder/Binder.h>
+#include <hwbinder/Parcel.h>
+
+using ::android::OK;
+using ::android::sp;
+using ::android::status_t;
+using ::android::UNKNOWN_TRANSACTION;
+using ::android::hardware::BHwBinder;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_memory;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::MQDescriptorSync;
+using ::android::hardware::Parcel;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::hidl::tests::benchmark::V1_0::BnHwBenchmark;
+using ::hidl::tests::benchmark::V1_0::BpHwBenchmark;
+using ::hidl::tests::benchmark::V1_0::IBenchmark;
+using ::hidl::tests::benchmark::V1_0::Matrix;
+using ::hidl::tests::benchmark::V1_0::Outer;
+using ::hidl::tests::benchmark::V1_0::Variant;
+
+namespace {
+
+// Leaves debug() to the generated default, which is what prints the stats.
+struct Benchmark : public IBenchmark {
+    Return<void> echoScalars(uint32_t a, int64_t b, bool c, uint8_t d, double e,
+                             echoScalars_cb _hidl_cb) override {
+        _hidl_cb(a, b, c, d, e);
+        return Void();
+    }
+    Return<void> echoString(const hidl_string& s, echoString_cb _hidl_cb) override {
+        _hidl_cb(s);
+        return Void();
+    }
+    Return<void> echoBytes(const hidl_vec<uint8_t>& data, echoBytes_cb _hidl_cb) override {
+        _hidl_cb(data);
+        return Void();
+    }
+    Return<void> echoNested(const hidl_vec<Outer>& data, echoNested_cb _hidl_cb) override {
+        _hidl_cb(data);
+        return Void();
+    }
+    Return<void> echoMatrix(const Matrix& m, echoMatrix_cb _hidl_cb) override {
+        _hidl_cb(m);
+        return Void();
+    }
+    Return<void> echoVariant(const Variant& v, echoVariant_cb _hidl_cb) override {
+        _hidl_cb(v);
+        return Void();
+    }
+    Return<void> echoHandle(const hidl_handle& h, echoHandle_cb _hidl_cb) override {
+        _hidl_cb(h);
+        return Void();
+    }
+    Return<void> echoMemory(const hidl_memory& m, echoMemory_cb _hidl_cb) override {
+        _hidl_cb(m);
+        return Void();
+    }
+    Return<void> echoQueue(const MQDescriptorSync<uint8_t>& q, echoQueue_cb _hidl_cb) override {
+        _hidl_cb(q);
+        return Void();
+    }
+};
+
+// Fails every transaction, so that the calls of a proxy talking to it fail.
+struct FailingBinder : public BHwBinder {
+    status_t onTransact(uint32_t, const Parcel&, Parcel*, uint32_t, TransactCallback) override {
+        return UNKNOWN_TRANSACTION;
+    }
+};
+
+// Returns what debug(fd, options) of service writes to fd.
+std::string debugOutput(const sp<IBenchmark>& service, const hidl_vec<hidl_string>& options) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        ADD_FAILURE() << "pipe: " << strerror(errno);
+        return "";
+    }
+
+    native_handle_t* handle = native_handle_create(1 /* numFds */, 0 /* numInts */);
+    handle->data[0] = fds[1];
+    EXPECT_TRUE(service->debug(hidl_handle(handle), options).isOk());
+    native_handle_close(handle);
+    native_handle_delete(handle);
+
+    std::string output;
+    EXPECT_TRUE(android::base::ReadFdToString(fds[0], &output));
+    close(fds[0]);
+    return output;
+}
+
+}  // namespace
+
+TEST(MethodStatsTest, DebugPrintsCallsAndErrors) {
+    sp<IBenchmark> impl = new Benchmark();
+    sp<BnHwBenchmark> stub = new BnHwBenchmark(impl);
+    sp<IBenchmark> proxy = new BpHwBenchmark(stub);
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        EXPECT_TRUE(proxy->echoScalars(i, 0, false, 0, 0.0, [](auto...) {}).isOk());
+    }
+    EXPECT_TRUE(proxy->echoString("stats", [](const auto&) {}).isOk());
+
+    // Fails in the stub, which does not accept the interface token.
+    // echoString is the second method of IBenchmark, so its transaction code is 2.
+    Parcel data;
+    Parcel reply;
+    ASSERT_EQ(OK, data.writeInterfaceToken("not.the.right@1.0::IBenchmark"));
+    EXPECT_NE(OK, stub->transact(2 /* echoString */, data, &reply));
+
+    // Fails in the proxy, since nothing serves the call.
+    sp<IBenchmark> failingProxy = new BpHwBenchmark(new FailingBinder());
+    EXPECT_FALSE(failingProxy->echoBytes(hidl_vec<uint8_t>(), [](const auto&) {}).isOk());
+
+    const std::string output = debugOutput(proxy, {"--stats"});
+    EXPECT_EQ(0u, output.find(std::string(IBenchmark::descriptor) + "\n")) << output;
+    EXPECT_NE(std::string::npos, output.find("proxy echoScalars: calls=2 errors=0 latency_us: <"))
+            << output;
+    EXPECT_NE(std::string::npos, output.find("stub echoScalars: calls=2 errors=0 latency_us: <"))
+            << output;
+    EXPECT_NE(std::string::npos, output.find("proxy echoString: calls=1 errors=0 latency_us: <"))
+            << output;
+    EXPECT_NE(std::string::npos, output.find("stub echoString: calls=2 errors=1 latency_us: <"))
+            << output;
+    EXPECT_NE(std::string::npos, output.find("proxy echoBytes: calls=1 errors=1 latency_us: <"))
+            << output;
+    // Methods which were never called are left out.
+    EXPECT_EQ(std::string::npos, output.find("stub echoBytes")) << output;
+    EXPECT_EQ(std::string::npos, output.find("echoMatrix")) << output;
+
+    // Without "--stats" the default debug() prints nothing.
+    EXPECT_EQ("", debugOutput(proxy, {}));
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks that a proxy starts the threadpool of its process before the first call which passes
+// an interface, rather than relying on something else having started it earlier.
+//
+// The server is forked off before this process touches binder, so the test runs in a process
+// which has never started a threadpool. The server calls the callback from another thread while
+// the caller still waits for the reply, so only a threadpool thread of this process can serve
+// it. A threadpool started after the transaction, or not at all, leaves the callback pending.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+
+#include <android-base/logging.h>
+#include <gtest/gtest.h>
+#include <hidl/HidlTransportSupport.h>
+#include <hidl/tests/threadpool/1.0/ICallback.h>
+#include <hidl/tests/threadpool/1.0/IServer.h>
+
+using ::android::OK;
+using ::android::sp;
+using ::android::hardware::configureRpcThreadpool;
+using ::android::hardware::joinRpcThreadpool;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::hidl::tests::threadpool::V1_0::ICallback;
+using ::hidl::tests::threadpool::V1_0::IServer;
+
+using namespace std::chrono_literals;
+
+namespace {
+
+const char* const kInstance = "hidl_thread_pool_test";
+
+struct Server : public IServer {
+    Return<bool> callFromAnotherThread(const sp<ICallback>& cb) override {
+        auto notified = std::make_shared<std::promise<bool>>();
+        std::future<bool> result = notified->get_future();
+        std::thread([cb, notified] { notified->set_value(cb->notify().isOk()); }).detach();
+        return result.wait_for(1s) == std::future_status::ready && result.get();
+    }
+};
+
+struct Callback : public ICallback {
+    Return<void> notify() override {
+        calls++;
+        return Void();
+    }
+
+    std::atomic<int> calls{0};
+};
+
+}  // namespace
+
+TEST(ThreadPoolTest, FirstCallPassingAnInterface) {
+    // tryGetService, unlike getService, does not register for notifications, which would start
+    // the threadpool itself.
+    sp<IServer> server;
+    for (int i = 0; i < 50 && server == nullptr; ++i) {
+        server = IServer::tryGetService(kInstance);
+        if (server == nullptr) std::this_thread::sleep_for(100ms);
+    }
+    ASSERT_NE(nullptr, server.get());
+    ASSERT_TRUE(server->isRemote());
+
+    // The first call has to start the threadpool, the second one finds it started.
+    for (int i = 0; i < 2; ++i) {
+        sp<Callback> cb = new Callback();
+        Return<bool> notified = server->callFromAnotherThread(cb);
+        ASSERT_TRUE(notified.isOk()) << "call " << i;
+        EXPECT_TRUE(static_cast<bool>(notified)) << "call " << i;
+        EXPECT_EQ(1, cb->calls) << "call " << i;
+    }
+}
+
+int main(int argc, char** argv) {
+    pid_t child = fork();
+    CHECK_NE(-1, child) << strerror(errno);
+    if (child == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        configureRpcThreadpool(1, true /* callerWillJoin */);
+        sp<IServer> server = new Server();
+        CHECK_EQ(OK, server->registerAsService(kInstance));
+        joinRpcThreadpool();
+        return EXIT_FAILURE;  // joinRpcThreadpool does not return
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    int status = RUN_ALL_TESTS();
+
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    return status;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Built twice (see Android.bp): hidl_to_string_test uses the regular headers,
+// where toString() is inline, and hidl_to_string_test_out_of_line uses code
+// generated with -t. Both expect the same strings, so passing both means that
+// -t does not change what toString() returns.
+//
+// The strings of fields are built with the toString() of libhidl, which is the
+// same in both, so that only what hidl-gen emits is under test.
+
+#include <gtest/gtest.h>
+#include <hidl/tests/benchmark/1.0/types.h>
+#include <hidl/tests/vendor/1.0/IVendor.h>
+#include <hidl/tests/vendor/1.0/types.h>
+
+using ::android::hardware::hidl_vec;
+using ::hidl::tests::benchmark::V1_0::Inner;
+using ::hidl::tests::benchmark::V1_0::Matrix;
+using ::hidl::tests::benchmark::V1_0::Outer;
+using ::hidl::tests::benchmark::V1_0::Variant;
+using ::hidl::tests::vendor::V1_0::Bar;
+using ::hidl::tests::vendor::V1_0::Foo;
+using ::hidl::tests::vendor::V1_0::FooToo;
+using ::hidl::tests::vendor::V1_0::IVendor;
+
+using namespace std::string_literals;
+
+TEST(ToStringTest, Enum) {
+    using ::hidl::tests::vendor::V1_0::toString;
+
+    EXPECT_EQ("A"s, toString(Bar::A));
+    EXPECT_EQ("B"s, toString(Foo::B));
+    EXPECT_EQ("0x5"s, toString(static_cast<Foo>(5)))
+            << "Invalid enum isn't stringified correctly.";
+
+    // inheritance
+    EXPECT_EQ("A"s, toString(Foo::A));
+    EXPECT_EQ("A"s, toString(FooToo::A));
+    EXPECT_EQ("C"s, toString(FooToo::C));
+    EXPECT_EQ("D"s, toString(FooToo::D));
+
+    // bitfields; A is 0, so it is always part of them.
+    EXPECT_EQ("A | B (0x1)"s, toString<Foo>(static_cast<uint32_t>(Foo::B)));
+    EXPECT_EQ("A | B | C (0x3)"s, toString<Foo>(Foo::B | Foo::C));
+    EXPECT_EQ("A | B | C | 0x8 (0xb)"s, toString<Foo>(static_cast<uint32_t>(0xb)));
+}
+
+TEST(ToStringTest, Struct) {
+    using ::android::hardware::toString;
+
+    Inner inner;
+    inner.data = hidl_vec<uint8_t>{1, 2, 3};
+    inner.tag = 42;
+    EXPECT_EQ("{.data = " + toString(inner.data) + ", .tag = " + toString(inner.tag) + "}",
+              toString(inner));
+
+    Outer outer;
+    outer.inners = hidl_vec<Inner>{inner, Inner()};
+    outer.name = "outer";
+    EXPECT_EQ("{.inners = " + toString(outer.inners) + ", .name = " + toString(outer.name) +
+                      "}",
+              toString(outer));
+    // The elements of the vector go through the toString() of Inner.
+    EXPECT_NE(std::string::npos, toString(outer.inners).find(toString(inner)));
+
+    Matrix matrix;
+    for (size_t i = 0; i < 16; ++i) {
+        for (size_t j = 0; j < 16; ++j) {
+            matrix.values[i][j] = static_cast<float>(i * 16 + j);
+        }
+    }
+    EXPECT_EQ("{.values = " + toString(matrix.values) + "}", toString(matrix));
+}
+
+TEST(ToStringTest, Union) {
+    using ::android::hardware::toString;
+
+    Variant variant;
+    variant.u64 = 0x0123456789abcdef;
+    EXPECT_EQ("{.u64 = " + toString(variant.u64) + ", .f64 = " + toString(variant.f64) +
+                      ", .bytes = " + toString(variant.bytes) + "}",
+              toString(variant));
+}
+
+TEST(ToStringTest, NestedStruct) {
+    using ::android::hardware::toString;
+
+    IVendor::StructTest s;
+    s.b = hidl_vec<uint8_t>{4, 5};
+    s.d = "nested";
+    for (size_t i = 0; i < 4; ++i) {
+        for (size_t j = 0; j < 4; ++j) {
+            s.e[i][j] = static_cast<uint8_t>(i + j);
+        }
+    }
+    EXPECT_EQ("{.b = " + toString(s.b) + ", .d = " + toString(s.d) + ", .e = " + toString(s.e) +
+                      "}",
+              toString(s));
+}
@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Measures how long hidl-gen spends in each of its phases on large synthesized
+// packages, together with the peak RSS of the process. Run with
+// ANDROID_BUILD_TOP set, since android.hidl.base@1.0 is read from the tree.
+
+#include <AST.h>
+#include <Coordinator.h>
+#include <Phase.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <ftw.h>
+#include <inttypes.h>
+#include <hidl-util/FQName.h>
+#include <hidl-util/Formatter.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace android;
+
+using Clock = std::chrono::steady_clock;
+
+static const char* kRoot = "bench";
+
+struct Options {
+    size_t numInterfaces = 200;
+    size_t importDepth = 32;
+    size_t enumValues = 1000;
+    size_t nestingDepth = 32;
+};
+
+struct PhaseStats {
+    size_t calls = 0;
+    Clock::duration total{};  // including nested phases
+    Clock::duration self{};   // excluding nested phases
+};
+
+struct OpenPhase {
+    const ScopedPhase* phase;
+    Clock::time_point start;
+    Clock::duration nested;
+};
+
+// Accumulates the time spent in each phase, and the counters.
+struct StatsListener : public ScopedPhase::Listener {
+    void onPhaseBegin(const ScopedPhase& phase) override {
+        tOpenPhases.push_back({&phase, Clock::now(), Clock::duration::zero()});
+    }
+
+    void onPhaseEnd(const ScopedPhase& phase) override {
+        const Clock::time_point now = Clock::now();
+
+        CHECK(!tOpenPhases.empty() && tOpenPhases.back().phase == &phase);
+        const OpenPhase open = tOpenPhases.back();
+        tOpenPhases.pop_back();
+
+        const Clock::duration total = now - open.start;
+        if (!tOpenPhases.empty()) {
+            tOpenPhases.back().nested += total;
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        PhaseStats& stats = mStats[phase.name()];
+        stats.calls++;
+        stats.total += total;
+        stats.self += total - open.nested;
+    }
+
+    void onCounter(const char* name, int64_t delta) override {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCounters[name] += delta;
+    }
+
+    std::mutex mMutex;
+    std::map<std::string, PhaseStats> mStats;
+    std::map<std::string, int64_t> mCounters;
+
+    static thread_local std::vector<OpenPhase> tOpenPhases;
+};
+
+thread_local std::vector<OpenPhase> StatsListener::tOpenPhases;
+
+static void writeFile(const std::string& path, const std::string& contents) {
+    std::ofstream stream(path);
+    stream << contents;
+    CHECK(stream.good()) << path;
+}
+
+static std::string makePackageDir(const std::string& rootDir, const std::string& name) {
+    const std::string packageDir = rootDir + "/" + name;
+    const std::string versionDir = packageDir + "/1.0";
+    CHECK(mkdir(packageDir.c_str(), 0755) == 0) << packageDir;
+    CHECK(mkdir(versionDir.c_str(), 0755) == 0) << versionDir;
+    return versionDir;
+}
+
+static std::string chainPackage(size_t i) {
+    return std::string(kRoot) + ".chain" + std::to_string(i) + "@1.0";
+}
+
+// bench.chain<i>@1.0 imports bench.chain<i - 1>@1.0, and its Link refers to the previous one.
+static void writeChainPackages(const std::string& rootDir, const Options& options) {
+    for (size_t i = 0; i < options.importDepth; i++) {
+        const std::string dir = makePackageDir(rootDir, "chain" + std::to_string(i));
+
+        std::string hal = "package " + chainPackage(i) + ";\n\n";
+        if (i > 0) {
+            hal += "import " + chainPackage(i - 1) + ";\n\n";
+        }
+        hal += "struct Link {\n";
+        if (i > 0) {
+            hal += "    " + chainPackage(i - 1) + "::Link previous;\n";
+        }
+        hal += "    uint32_t value;\n};\n";
+
+        writeFile(dir + "/types.hal", hal);
+    }
+}
+
+static std::string nestedStruct(size_t level, size_t depth, const std::string& indent) {
+    const std::string name = "Level" + std::to_string(level);
+    std::string hal = indent + "struct " + name + " {\n";
+    if (level + 1 < depth) {
+        const std::string child = "Level" + std::to_string(level + 1);
+        hal += nestedStruct(level + 1, depth, indent + "    ");
+        hal += indent + "    " + child + " child;\n";
+        hal += indent + "    vec<" + child + "> children;\n";
+    }
+    hal += indent + "    uint32_t value;\n";
+    hal += indent + "    vec<uint8_t> data;\n";
+    hal += indent + "};\n";
+    return hal;
+}
+
+// bench.big@1.0 holds a large enum and deeply nested structs in types.hal, and
+// numInterfaces interfaces which inherit from one another in chains of ten.
+static void writeBigPackage(const std::string& rootDir, const Options& options) {
+    const std::string dir = makePackageDir(rootDir, "big");
+    const std::string package = std::string(kRoot) + ".big@1.0";
+    const std::string lastLink =
+            options.importDepth > 0 ? chainPackage(options.importDepth - 1) + "::Link" : "";
+
+    std::string types = "package " + package + ";\n\n";
+    if (!lastLink.empty()) {
+        types += "import " + chainPackage(options.importDepth - 1) + ";\n\n";
+    }
+    types += "enum Big : uint32_t {\n";
+    for (size_t i = 0; i < options.enumValues; i++) {
+        // Every eighth value is an expression, the rest are autofilled.
+        types += "    V" + std::to_string(i);
+        if (i > 0 && i % 8 == 0) {
+            types += " = V" + std::to_string(i - 1) + " + 1";
+        }
+        types += ",\n";
+    }
+    types += "};\n\n";
+    if (options.nestingDepth > 0) {
+        types += nestedStruct(0, options.nestingDepth, "");
+    }
+    writeFile(dir + "/types.hal", types);
+
+    for (size_t i = 0; i < options.numInterfaces; i++) {
+        const std::string name = "IFace" + std::to_string(i);
+        const std::string prefix = "f" + std::to_string(i) + "_";
+
+        std::string hal = "package " + package + ";\n\n";
+        if (!lastLink.empty()) {
+            hal += "import " + chainPackage(options.importDepth - 1) + ";\n\n";
+        }
+        hal += "interface " + name;
+        if (i % 10 != 0) {
+            hal += " extends IFace" + std::to_string(i - 1);
+        }
+        hal += " {\n";
+        hal += "    " + prefix + "0(uint32_t a, Big b) generates (Big r);\n";
+        hal += "    " + prefix + "1(string s, vec<string> v) generates (vec<uint32_t> r);\n";
+        if (options.nestingDepth > 0) {
+            hal += "    " + prefix + "2(Level0 l) generates (vec<Level0> r);\n";
+        }
+        if (!lastLink.empty()) {
+            hal += "    " + prefix + "3(" + lastLink + " l) generates (" + lastLink + " r);\n";
+        }
+        if (i > 0) {
+            hal += "    " + prefix + "4(IFace" + std::to_string(i - 1) + " callback);\n";
+        }
+        hal += "    oneway " + prefix + "5(uint8_t[4][4] m, vec<vec<Big>> v);\n";
+        hal += "};\n";
+
+        writeFile(dir + "/" + name + ".hal", hal);
+    }
+}
+
+static void removeTree(const std::string& path) {
+    nftw(path.c_str(),
+         [](const char* file, const struct stat*, int, struct FTW*) { return remove(file); },
+         16 /* nopenfd */, FTW_DEPTH | FTW_PHYS);
+}
+
+static Formatter nullFormatter() {
+    FILE* file = fopen("/dev/null", "w");
+    CHECK(file != nullptr);
+    return Formatter(file);
+}
+
+static void generateAll(const AST* ast) {
+    using Generator = void (AST::*)(Formatter&) const;
+    static const std::vector<std::pair<const char*, Generator>> kGenerators = {
+            {"generateInterfaceHeader", &AST::generateInterfaceHeader},
+            {"generateHwBinderHeader", &AST::generateHwBinderHeader},
+            {"generateCppSource", &AST::generateCppSource},
+            {"generateVts", &AST::generateVts},
+    };
+    static const std::vector<std::pair<const char*, Generator>> kInterfaceGenerators = {
+            {"generateStubHeader", &AST::generateStubHeader},
+            {"generateProxyHeader", &AST::generateProxyHeader},
+            {"generatePassthroughHeader", &AST::generatePassthroughHeader},
+    };
+
+    for (const auto& generator : kGenerators) {
+        ScopedPhase phase(generator.first);
+        Formatter out = nullFormatter();
+        (ast->*generator.second)(out);
+    }
+
+    if (ast->isInterface()) {
+        for (const auto& generator : kInterfaceGenerators) {
+            ScopedPhase phase(generator.first);
+            Formatter out = nullFormatter();
+            (ast->*generator.second)(out);
+        }
+    }
+
+    if (ast->isJavaCompatible()) {
+        ScopedPhase phase("generateJava");
+        Formatter out = nullFormatter();
+        if (ast->isInterface()) {
+            ast->generateJava(out, "" /* limitToType */);
+        } else {
+            ast->generateJavaTypes(out, "" /* limitToType */);
+        }
+    }
+}
+
+static void usage(const char* me) {
+    fprintf(stderr,
+            "usage: %s [-i <interfaces>] [-d <import depth>] [-e <enum values>] "
+            "[-n <struct nesting depth>]\n",
+            me);
+}
+
+int main(int argc, char** argv) {
+    const char* me = argv[0];
+    Options options;
+
+    int res;
+    while ((res = getopt(argc, argv, "i:d:e:n:h")) >= 0) {
+        size_t* value = nullptr;
+        switch (res) {
+            case 'i': value = &options.numInterfaces; break;
+            case 'd': value = &options.importDepth; break;
+            case 'e': value = &options.enumValues; break;
+            case 'n': value = &options.nestingDepth; break;
+            default:
+                usage(me);
+                return 1;
+        }
+        if (!base::ParseUint(optarg, value)) {
+            usage(me);
+            return 1;
+        }
+    }
+
+    const char* buildTop = getenv("ANDROID_BUILD_TOP");
+    if (buildTop == nullptr) {
+        fprintf(stderr, "ERROR: ANDROID_BUILD_TOP must be set.\n");
+        return 1;
+    }
+
+    char tmpl[] = "/tmp/hidl-gen-benchmark-XXXXXX";
+    CHECK(mkdtemp(tmpl) != nullptr);
+    const std::string rootDir = tmpl;
+
+    writeChainPackages(rootDir, options);
+    writeBigPackage(rootDir, options);
+
+    StatsListener listener;
+    ScopedPhase::setListener(&listener);
+
+    Coordinator coordinator;
+    coordinator.setRootPath(buildTop);
+    coordinator.addDefaultPackagePath("android.hidl", "system/libhidl/transport");
+    std::string error;
+    CHECK(coordinator.addPackagePath(kRoot, rootDir, &error) == OK) << error;
+
+    std::vector<FQName> packages;
+    for (size_t i = 0; i < options.importDepth; i++) {
+        packages.push_back(FQName(chainPackage(i)));
+    }
+    packages.push_back(FQName(std::string(kRoot) + ".big@1.0"));
+
+    const Clock::time_point start = Clock::now();
+    bool failed = false;
+
+    for (const FQName& package : packages) {
+        std::vector<FQName> targets;
+        CHECK(coordinator.appendPackageInterfacesToVector(package, &targets) == OK);
+
+        for (const FQName& target : targets) {
+            AST* ast = coordinator.parse(target);
+            if (ast == nullptr) {
+                fprintf(stderr, "ERROR: Could not parse %s.\n", target.string().c_str());
+                failed = true;
+                continue;
+            }
+            generateAll(ast);
+        }
+    }
+
+    const Clock::duration wall = Clock::now() - start;
+    ScopedPhase::setListener(nullptr);
+    removeTree(rootDir);
+
+    if (failed) return 1;
+
+    const auto ms = [](Clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+
+    printf("%-36s %8s %12s %12s\n", "phase", "calls", "self (ms)", "total (ms)");
+    for (const auto& pair : listener.mStats) {
+        printf("%-36s %8zu %12.2f %12.2f\n", pair.first.c_str(), pair.second.calls,
+               ms(pair.second.self), ms(pair.second.total));
+    }
+
+    printf("\n");
+    for (const auto& pair : listener.mCounters) {
+        printf("%-36s %" PRId64 "\n", pair.first.c_str(), pair.second);
+    }
+
+    struct rusage usage;
+    CHECK(getrusage(RUSAGE_SELF, &usage) == 0);
+    printf("\nwall time: %.2f ms\npeak RSS: %ld KiB\n", ms(wall), usage.ru_maxrss);
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+#!/bin/bash
+
+# Compares the time it takes to compile a file which includes the types.h of a
+# package (-Lc++-headers) with the time it takes when it only includes the
+# types/<Type>.h it needs (-Lc++-headers-split), for each type in types.hal of
+# each package given. Imported packages must be given too, since their headers
+# are generated the same way.
+#
+# usage: split_headers.sh android.hardware.foo@1.0 [android.hardware.bar@1.0 ...]
+#
+# Run from ANDROID_BUILD_TOP after building hidl-gen, e.g.
+#   split_headers.sh $(cd hardware/interfaces && find . -name types.hal \
+#       | sed -n 's@^\./\(.*\)/\([0-9.]*\)/types.hal$@android.hardware.\1\@\2@p' | tr / .)
+
+set -e
+
+if [ -z "${ANDROID_BUILD_TOP}" ] ; then
+    echo "ANDROID_BUILD_TOP must be set." >&2
+    exit 1
+fi
+
+if [ $# -eq 0 ] ; then
+    echo "usage: $0 <package> [<package> ...]" >&2
+    exit 1
+fi
+
+CXX=${CXX:-clang++}
+OUT=$(mktemp -d /tmp/hidl-gen-split-headers-XXXXXX)
+trap 'rm -rf "${OUT}"' EXIT
+
+ROOTS="-r android.hardware:hardware/interfaces -r android.hidl:system/libhidl/transport"
+INCLUDES=""
+for dir in system/libhidl/base/include system/libhidl/transport/include \
+        system/libhwbinder/include system/libfmq/include system/core/base/include \
+        system/core/libcutils/include system/core/liblog/include \
+        system/core/libsystem/include system/core/libutils/include ; do
+    INCLUDES="${INCLUDES} -I${ANDROID_BUILD_TOP}/${dir}"
+done
+
+cd "${ANDROID_BUILD_TOP}"
+for package in "$@" ; do
+    hidl-gen -o "${OUT}/monolithic" -L c++-headers ${ROOTS} "${package}"
+    hidl-gen -o "${OUT}/split" -L c++-headers-split ${ROOTS} "${package}"
+done
+
+# Prints the seconds it takes to compile a file including the given header.
+function compile_time() {
+    local root=$1
+    local header=$2
+    local start=$(date +%s.%N)
+    echo "#include <${header}>" | "${CXX}" -std=c++17 -fsyntax-only -x c++ \
+        -I"${root}" ${INCLUDES} -
+    echo "$(date +%s.%N) - ${start}" | bc
+}
+
+total_monolithic=0
+total_split=0
+for package in "$@" ; do
+    # android.hardware.foo@1.0 -> android/hardware/foo/1.0
+    dir="$(echo "${package%@*}" | tr . /)/${package#*@}"
+    [ -d "${OUT}/split/${dir}/types" ] || continue
+
+    for header in "${OUT}"/split/"${dir}"/types/*.h ; do
+        name=$(basename "${header}")
+        [[ "${name}" == hw* ]] && continue
+
+        monolithic=$(compile_time "${OUT}/monolithic" "${dir}/types.h")
+        split=$(compile_time "${OUT}/split" "${dir}/types/${name}")
+        printf "%-60s %8.3f %8.3f\n" "${package}::${name%.h}" "${monolithic}" "${split}"
+
+        total_monolithic=$(echo "${total_monolithic} + ${monolithic}" | bc)
+        total_split=$(echo "${total_split} + ${split}" | bc)
+    done
+done
+
+printf "%-60s %8.3f %8.3f\n" "total (s): types.h vs types/<Type>.h" \
+    "${total_monolithic}" "${total_split}"
@@ -11,6 +11,10 @@ function run() {
 
     local RUN_TIME_TESTS=(\
         libhidl-gen-utils_test \
+        hidl_method_stats_test \
+        hidl_thread_pool_test \
+        hidl_to_string_test \
+        hidl_to_string_test_out_of_line \
     )
     RUN_TIME_TESTS+=(${RELATED_RUNTIME_TESTS[@]})
 
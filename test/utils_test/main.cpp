@@ -16,13 +16,23 @@
 
 #define LOG_TAG "libhidl-gen-utils"
 
+#include <hidl-util/FQName.h>
 #include <hidl-util/FqInstance.h>
+#include <hidl-util/Formatter.h>
 #include <hidl-util/StringHelper.h>
 
 #include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
 #include <vector>
 
+using ::android::FQName;
 using ::android::FqInstance;
+using ::android::Formatter;
 using ::android::StringHelper;
 
 class LibHidlGenUtilsTest : public ::testing::Test {};
@@ -190,6 +200,86 @@ TEST_F(LibHidlGenUtilsTest, FqInstanceIdentifier) {
     ASSERT_FALSE(e.hasInstance());
 }
 
+TEST_F(LibHidlGenUtilsTest, FQNameParse) {
+    FQName fqName;
+    ASSERT_TRUE(FQName::parse("android.hardware.foo@1.2::IFoo.Type:MY_ENUM_VALUE", &fqName));
+    EXPECT_EQ("android.hardware.foo", fqName.package());
+    EXPECT_EQ("1.2", fqName.version());
+    EXPECT_EQ("IFoo.Type", fqName.name());
+    EXPECT_EQ("MY_ENUM_VALUE", fqName.valueName());
+    EXPECT_FALSE(fqName.isIdentifier());
+
+    ASSERT_TRUE(FQName::parse("Type", &fqName));
+    EXPECT_TRUE(fqName.isIdentifier());
+    ASSERT_TRUE(FQName::parse("IFoo.Type", &fqName));
+    EXPECT_FALSE(fqName.isIdentifier());
+
+    for (auto testString : {"", "@1.0", "a@1", "a@1.0::", "a@1.0:b", "a@1.0::b.", "a..b",
+                            "1a", "a::b", "a:b.c", "a@1.0::b:c:d", "a@1.0.1::b", "a@0.1:",
+                            "_@0.1b", "a@0.1::", "a@0.1::b:"}) {
+        EXPECT_FALSE(FQName::parse(testString, &fqName)) << testString;
+    }
+}
+
+TEST_F(LibHidlGenUtilsTest, FQNameCompare) {
+    FQName a("a.b", "1.0", "IFoo");
+    FQName b("a.b", "1.0", "IFoo.Type");
+    EXPECT_EQ("a.b@1.0::IFoo", a.string());
+    EXPECT_TRUE(a < b);
+    EXPECT_EQ(a, b.getTopLevelType());
+    EXPECT_EQ("a.b@1.1::IFoo", a.withVersion(1, 1).string());
+    EXPECT_EQ("a.b@1.0::IFoo", a.withVersion(1, 1).downRev().string());
+
+    FQName c("IFoo");
+    c.applyDefaults("a.b", "1.0");
+    EXPECT_EQ(a, c);
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream stream(path);
+    std::stringstream contents;
+    contents << stream.rdbuf();
+    return contents.str();
+}
+
+static time_t modificationTime(const std::string& path) {
+    struct stat st;
+    EXPECT_EQ(0, stat(path.c_str(), &st));
+    return st.st_mtime;
+}
+
+TEST_F(LibHidlGenUtilsTest, FormatterWritesOnlyIfChanged) {
+#ifdef __ANDROID__
+    std::string path = "/data/local/tmp/formatter_test.XXXXXX";
+#else
+    std::string path = "/tmp/formatter_test.XXXXXX";
+#endif
+    int fd = mkstemp(&path[0]);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    const auto write = [&](int value) {
+        Formatter out(path);
+        out << "struct Foo ";
+        out.block([&] { out << "int x = " << value << ";\n"; }).endl();
+        EXPECT_TRUE(out.close());
+    };
+
+    write(-1);
+    EXPECT_EQ("struct Foo {\n    int x = -1;\n}\n", readFile(path));
+
+    const struct timeval epoch[2] = {{0, 0}, {0, 0}};
+    ASSERT_EQ(0, utimes(path.c_str(), epoch));
+    write(-1);
+    EXPECT_EQ(0, modificationTime(path));
+
+    write(18);
+    EXPECT_EQ("struct Foo {\n    int x = 18;\n}\n", readFile(path));
+    EXPECT_NE(0, modificationTime(path));
+
+    unlink(path.c_str());
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
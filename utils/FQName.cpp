@@ -21,16 +21,53 @@
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
 #include <iostream>
-#include <regex>
 #include <sstream>
 
-#define RE_COMPONENT    "[a-zA-Z_][a-zA-Z_0-9]*"
-#define RE_PATH         RE_COMPONENT "(?:[.]" RE_COMPONENT ")*"
-#define RE_MAJOR        "[0-9]+"
-#define RE_MINOR        "[0-9]+"
-
 namespace android {
 
+// [a-zA-Z_]
+static bool isComponentStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+// [a-zA-Z_0-9]
+static bool isComponentChar(char c) {
+    return isComponentStart(c) || (c >= '0' && c <= '9');
+}
+
+// The scan* functions return the end of the longest match starting at pos, or npos if
+// there is none.
+
+// [a-zA-Z_][a-zA-Z_0-9]*
+static size_t scanComponent(const std::string& s, size_t pos) {
+    if (pos >= s.size() || !isComponentStart(s[pos])) return std::string::npos;
+    do {
+        pos++;
+    } while (pos < s.size() && isComponentChar(s[pos]));
+    return pos;
+}
+
+// component(.component)*
+static size_t scanPath(const std::string& s, size_t pos) {
+    pos = scanComponent(s, pos);
+    while (pos != std::string::npos && pos + 1 < s.size() && s[pos] == '.' &&
+           isComponentStart(s[pos + 1])) {
+        pos = scanComponent(s, pos + 1);
+    }
+    return pos;
+}
+
+// [0-9]+
+static size_t scanNumber(const std::string& s, size_t pos) {
+    const size_t start = pos;
+    while (pos < s.size() && s[pos] >= '0' && s[pos] <= '9') pos++;
+    return pos == start ? std::string::npos : pos;
+}
+
+static bool isPath(const std::string& s) {
+    return scanPath(s, 0) == s.size();
+}
+
 FQName::FQName()
     : mValid(false),
       mIsIdentifier(false) {
@@ -58,11 +95,16 @@ FQName::FQName(
       mName(name),
       mValueName(valueName) {
     CHECK(setVersion(version)) << version;
+    updateString();
 
-    // Check if this is actually a valid fqName
-    FQName other;
-    CHECK(parse(this->string(), &other)) << this->string();
-    CHECK((*this) == other) << this->string() << " " << other.string();
+    // Check if this is actually a valid fqName, i.e. that string() would parse back to it.
+    // Without a name, string() is just the package (and version).
+    CHECK(mName.empty()
+                  ? isPath(mPackage)
+                  : (isPath(mName) &&
+                     (mValueName.empty() || scanComponent(mValueName, 0) == mValueName.size()) &&
+                     (mPackage.empty() || (isPath(mPackage) && hasVersion()))))
+            << mString;
 }
 
 FQName::FQName(const FQName& other)
@@ -72,7 +114,8 @@ FQName::FQName(const FQName& other)
       mMajor(other.mMajor),
       mMinor(other.mMinor),
       mName(other.mName),
-      mValueName(other.mValueName) {
+      mValueName(other.mValueName),
+      mString(other.mString) {
 }
 
 bool FQName::isValid() const {
@@ -97,82 +140,73 @@ bool FQName::isInterfaceName() const {
 }
 
 bool FQName::setTo(const std::string &s) {
+    // Accepts, in a single pass:
     // android.hardware.foo@1.0::IFoo.Type
-    static const std::regex kRE1("(" RE_PATH ")@(" RE_MAJOR ")[.](" RE_MINOR ")::(" RE_PATH ")");
     // @1.0::IFoo.Type
-    static const std::regex kRE2("@(" RE_MAJOR ")[.](" RE_MINOR ")::(" RE_PATH ")");
     // android.hardware.foo@1.0 (for package declaration and whole package import)
-    static const std::regex kRE3("(" RE_PATH ")@(" RE_MAJOR ")[.](" RE_MINOR ")");
     // IFoo.Type
-    static const std::regex kRE4("(" RE_COMPONENT ")([.]" RE_COMPONENT ")+");
     // Type (a plain identifier)
-    static const std::regex kRE5("(" RE_COMPONENT ")");
-
     // android.hardware.foo@1.0::IFoo.Type:MY_ENUM_VALUE
-    static const std::regex kRE6("(" RE_PATH ")@(" RE_MAJOR ")[.](" RE_MINOR ")::(" RE_PATH
-                                 "):(" RE_COMPONENT ")");
     // @1.0::IFoo.Type:MY_ENUM_VALUE
-    static const std::regex kRE7("@(" RE_MAJOR ")[.](" RE_MINOR ")::(" RE_PATH "):(" RE_COMPONENT
-                                 ")");
     // IFoo.Type:MY_ENUM_VALUE
-    static const std::regex kRE8("(" RE_PATH "):(" RE_COMPONENT ")");
-
-    bool invalid = false;
     clear();
 
-    std::smatch match;
-    if (std::regex_match(s, match, kRE1)) {
-        CHECK_EQ(match.size(), 5u);
-
-        mPackage = match.str(1);
-        invalid |= !parseVersion(match.str(2), match.str(3));
-        mName = match.str(4);
-    } else if (std::regex_match(s, match, kRE2)) {
-        CHECK_EQ(match.size(), 4u);
-
-        invalid |= !parseVersion(match.str(1), match.str(2));
-        mName = match.str(3);
-    } else if (std::regex_match(s, match, kRE3)) {
-        CHECK_EQ(match.size(), 4u);
-
-        mPackage = match.str(1);
-        invalid |= !parseVersion(match.str(2), match.str(3));
-    } else if (std::regex_match(s, match, kRE4)) {
-        mName = match.str(0);
-    } else if (std::regex_match(s, match, kRE5)) {
-        mIsIdentifier = true;
-        mName = match.str(0);
-    } else if (std::regex_match(s, match, kRE6)) {
-        CHECK_EQ(match.size(), 6u);
-
-        mPackage = match.str(1);
-        invalid |= !parseVersion(match.str(2), match.str(3));
-        mName = match.str(4);
-        mValueName = match.str(5);
-    } else if (std::regex_match(s, match, kRE7)) {
-        CHECK_EQ(match.size(), 5u);
-
-        invalid |= !parseVersion(match.str(1), match.str(2));
-        mName = match.str(3);
-        mValueName = match.str(4);
-    } else if (std::regex_match(s, match, kRE8)) {
-        CHECK_EQ(match.size(), 3u);
-
-        mName = match.str(1);
-        mValueName = match.str(2);
-    } else {
-        invalid = true;
+    const size_t npos = std::string::npos;
+
+    size_t nameStart = 0;
+    const size_t packageEnd = scanPath(s, 0);
+    const size_t atPos = packageEnd == npos ? 0 : packageEnd;
+    const bool hasAtVersion = atPos < s.size() && s[atPos] == '@';
+
+    if (hasAtVersion) {
+        if (packageEnd != npos) {
+            mPackage = s.substr(0, packageEnd);
+        }
+
+        const size_t majorStart = atPos + 1;
+        const size_t majorEnd = scanNumber(s, majorStart);
+        if (majorEnd == npos || majorEnd >= s.size() || s[majorEnd] != '.') return mValid = false;
+        const size_t minorEnd = scanNumber(s, majorEnd + 1);
+        if (minorEnd == npos) return mValid = false;
+
+        if (!parseVersion(s.substr(majorStart, majorEnd - majorStart),
+                          s.substr(majorEnd + 1, minorEnd - majorEnd - 1))) {
+            return mValid = false;
+        }
+
+        if (minorEnd == s.size()) {
+            // A version needs either a package or a name to go with it.
+            if (mPackage.empty()) return mValid = false;
+            // package without version is not allowed.
+            CHECK(hasVersion()) << s;
+            updateString();
+            return true;
+        }
+
+        if (s.compare(minorEnd, 2, "::") != 0) return mValid = false;
+        nameStart = minorEnd + 2;
+    } else if (packageEnd == npos) {
+        return mValid = false;
     }
 
-    // mValueName must go with mName.
-    CHECK(mValueName.empty() || !mName.empty());
+    const size_t nameEnd = hasAtVersion ? scanPath(s, nameStart) : packageEnd;
+    if (nameEnd == npos) return mValid = false;
+    mName = s.substr(nameStart, nameEnd - nameStart);
+
+    if (nameEnd < s.size()) {
+        if (s[nameEnd] != ':' || scanComponent(s, nameEnd + 1) != s.size()) {
+            return mValid = false;
+        }
+        mValueName = s.substr(nameEnd + 1);
+    } else if (!hasAtVersion && mName.find('.') == std::string::npos) {
+        mIsIdentifier = true;
+    }
 
     // package without version is not allowed.
-    CHECK(invalid || mPackage.empty() || !version().empty());
+    CHECK(mPackage.empty() || hasVersion()) << s;
 
-    // TODO(b/73774955): remove isValid and users
-    // of old FQName constructors
-    return mValid = !invalid;
+    updateString();
+    return true;
 }
 
 const std::string& FQName::package() const {
@@ -205,23 +239,22 @@ void FQName::clear() {
     clearVersion();
     mName.clear();
     mValueName.clear();
+    mString.clear();
 }
 
 bool FQName::setVersion(const std::string& v) {
-    static const std::regex kREVer("(" RE_MAJOR ")[.](" RE_MINOR ")");
-
     if (v.empty()) {
         clearVersion();
         return true;
     }
 
-    std::smatch match;
-    if (!std::regex_match(v, match, kREVer)) {
+    const size_t majorEnd = scanNumber(v, 0);
+    if (majorEnd == std::string::npos || majorEnd >= v.size() || v[majorEnd] != '.' ||
+        scanNumber(v, majorEnd + 1) != v.size()) {
         return mValid = false;
     }
-    CHECK_EQ(match.size(), 3u);
 
-    return parseVersion(match.str(1), match.str(2));
+    return parseVersion(v.substr(0, majorEnd), v.substr(majorEnd + 1));
 }
 
 void FQName::clearVersion() {
@@ -275,27 +308,36 @@ void FQName::applyDefaults(
     if (version().empty()) {
         CHECK(setVersion(defaultVersion));
     }
+
+    updateString();
 }
 
-std::string FQName::string() const {
+const std::string& FQName::string() const {
     CHECK(mValid) << mPackage << atVersion() << mName;
 
-    std::string out;
-    out.append(mPackage);
-    out.append(atVersion());
+    return mString;
+}
+
+void FQName::updateString() {
+    mString.clear();
+    mString.append(mPackage);
+    if (hasVersion()) {
+        mString.append("@");
+        mString.append(std::to_string(mMajor));
+        mString.append(".");
+        mString.append(std::to_string(mMinor));
+    }
     if (!mName.empty()) {
-        if (!mPackage.empty() || !version().empty()) {
-            out.append("::");
+        if (!mPackage.empty() || hasVersion()) {
+            mString.append("::");
         }
-        out.append(mName);
+        mString.append(mName);
 
         if (!mValueName.empty()) {
-            out.append(":");
-            out.append(mValueName);
+            mString.append(":");
+            mString.append(mValueName);
         }
     }
-
-    return out;
 }
 
 bool FQName::operator<(const FQName &other) const {
@@ -464,6 +506,7 @@ FQName FQName::withVersion(size_t major, size_t minor) const {
     FQName ret(*this);
     ret.mMajor = major;
     ret.mMinor = minor;
+    ret.updateString();
     return ret;
 }
 
@@ -480,8 +523,8 @@ size_t FQName::getPackageMinorVersion() const {
 }
 
 bool FQName::endsWith(const FQName &other) const {
-    std::string s1 = string();
-    std::string s2 = other.string();
+    const std::string& s1 = string();
+    const std::string& s2 = other.string();
 
     size_t pos = s1.rfind(s2);
     if (pos == std::string::npos || pos + s2.size() != s1.size()) {
@@ -539,6 +582,7 @@ FQName FQName::downRev() const {
     FQName ret(*this);
     CHECK(ret.mMinor > 0);
     ret.mMinor--;
+    ret.updateString();
     return ret;
 }
 
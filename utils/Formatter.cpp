@@ -17,24 +17,99 @@
 #include "Formatter.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include <android-base/logging.h>
+#include <charconv>
 
 namespace android {
 
+// typical size of a generated file, so that the buffer rarely grows
+static constexpr size_t kInitialBufferSize = 64 * 1024;
+
 Formatter::Formatter() : mFile(NULL /* invalid */), mIndentDepth(0), mAtStartOfLine(true) {}
 
 Formatter::Formatter(FILE* file, size_t spacesPerIndent)
     : mFile(file == NULL ? stdout : file),
       mIndentDepth(0),
       mSpacesPerIndent(spacesPerIndent),
-      mAtStartOfLine(true) {}
+      mAtStartOfLine(true) {
+    mBuffer.reserve(kInitialBufferSize);
+}
+
+Formatter::Formatter(const std::string& path, size_t spacesPerIndent)
+    : mFile(NULL),
+      mPath(path),
+      mIndentDepth(0),
+      mSpacesPerIndent(spacesPerIndent),
+      mAtStartOfLine(true) {
+    CHECK(!mPath.empty());
+    mBuffer.reserve(kInitialBufferSize);
+}
+
+Formatter::Formatter(Formatter&& other)
+    : mFile(other.mFile),
+      mPath(std::move(other.mPath)),
+      mBuffer(std::move(other.mBuffer)),
+      mIndentDepth(other.mIndentDepth),
+      mSpacesPerIndent(other.mSpacesPerIndent),
+      mAtStartOfLine(other.mAtStartOfLine),
+      mSpace(std::move(other.mSpace)),
+      mLinePrefix(std::move(other.mLinePrefix)) {
+    // leaves other invalid, so that it doesn't write or close anything
+    other.mFile = NULL;
+    other.mPath.clear();
+}
 
 Formatter::~Formatter() {
-    if (mFile != stdout) {
-        fclose(mFile);
+    close();
+}
+
+// Returns true if the file at path exists with exactly these contents.
+static bool hasContents(const std::string& path, const std::string& contents) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == NULL) return false;
+
+    struct stat st;
+    bool same = fstat(fileno(file), &st) == 0 &&
+                static_cast<size_t>(st.st_size) == contents.size();
+
+    char buffer[16384];
+    for (size_t offset = 0; same && offset < contents.size();) {
+        size_t n = fread(buffer, 1, sizeof(buffer), file);
+        same = n > 0 && contents.compare(offset, n, buffer, n) == 0;
+        offset += n;
     }
+
+    fclose(file);
+    return same;
+}
+
+bool Formatter::close() {
+    if (!isValid()) return true;
+
+    bool ok = true;
+    if (!mPath.empty()) {
+        if (!hasContents(mPath, mBuffer)) {
+            FILE* file = fopen(mPath.c_str(), "wb");
+            ok = file != NULL && fwrite(mBuffer.data(), 1, mBuffer.size(), file) == mBuffer.size();
+            ok = (file == NULL || fclose(file) == 0) && ok;
+            if (!ok) {
+                fprintf(stderr, "ERROR: could not write file %s: %s\n", mPath.c_str(),
+                        strerror(errno));
+            }
+        }
+    } else {
+        ok = fwrite(mBuffer.data(), 1, mBuffer.size(), mFile) == mBuffer.size();
+        ok = (mFile == stdout ? fflush(mFile) : fclose(mFile)) == 0 && ok;
+    }
+
     mFile = NULL;
+    mPath.clear();
+    mBuffer.clear();
+    return ok;
 }
 
 void Formatter::indent(size_t level) {
@@ -116,45 +191,50 @@ Formatter& Formatter::sWhile(const std::string& cond, const std::function<void(v
 }
 
 Formatter &Formatter::operator<<(const std::string &out) {
-    const size_t len = out.length();
+    print(out.data(), out.size());
+    return *this;
+}
+
+void Formatter::startLine() {
+    mBuffer.append(mSpacesPerIndent * mIndentDepth, ' ');
+    mBuffer.append(mLinePrefix);
+}
+
+void Formatter::print(const char* data, size_t size) {
     size_t start = 0;
-    while (start < len) {
-        size_t pos = out.find('\n', start);
+    while (start < size) {
+        const char* newline = static_cast<const char*>(memchr(data + start, '\n', size - start));
 
-        if (pos == std::string::npos) {
+        if (newline == nullptr) {
             if (mAtStartOfLine) {
-                fprintf(mFile, "%*s", (int)(mSpacesPerIndent * mIndentDepth), "");
-                fprintf(mFile, "%s", mLinePrefix.c_str());
+                startLine();
                 mAtStartOfLine = false;
             }
 
-            output(out.substr(start));
+            output(data + start, size - start);
             break;
         }
 
+        const size_t pos = newline - data;
+
         if (mAtStartOfLine && (pos > start || !mLinePrefix.empty())) {
-            fprintf(mFile, "%*s", (int)(mSpacesPerIndent * mIndentDepth), "");
-            fprintf(mFile, "%s", mLinePrefix.c_str());
+            startLine();
         }
 
-        if (pos == start) {
-            fprintf(mFile, "\n");
-            mAtStartOfLine = true;
-        } else if (pos > start) {
-            output(out.substr(start, pos - start + 1));
-            mAtStartOfLine = true;
-        }
+        output(data + start, pos - start + 1);
+        mAtStartOfLine = true;
 
         start = pos + 1;
     }
-
-    return *this;
 }
 
 // NOLINT to suppress missing parentheses warning about __type__.
-#define FORMATTER_INPUT_INTEGER(__type__)                       \
-    Formatter& Formatter::operator<<(__type__ n) { /* NOLINT */ \
-        return (*this) << std::to_string(n);                    \
+#define FORMATTER_INPUT_INTEGER(__type__)                                    \
+    Formatter& Formatter::operator<<(__type__ n) { /* NOLINT */              \
+        char buffer[24];                                                     \
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), n);     \
+        print(buffer, result.ptr - buffer);                                  \
+        return *this;                                                        \
     }
 
 FORMATTER_INPUT_INTEGER(short);
@@ -165,16 +245,27 @@ FORMATTER_INPUT_INTEGER(long);
 FORMATTER_INPUT_INTEGER(unsigned long);
 FORMATTER_INPUT_INTEGER(long long);
 FORMATTER_INPUT_INTEGER(unsigned long long);
-FORMATTER_INPUT_INTEGER(float);
-FORMATTER_INPUT_INTEGER(double);
-FORMATTER_INPUT_INTEGER(long double);
 
 #undef FORMATTER_INPUT_INTEGER
 
+// NOLINT to suppress missing parentheses warning about __type__.
+#define FORMATTER_INPUT_FLOAT(__type__)                         \
+    Formatter& Formatter::operator<<(__type__ n) { /* NOLINT */ \
+        return (*this) << std::to_string(n);                    \
+    }
+
+FORMATTER_INPUT_FLOAT(float);
+FORMATTER_INPUT_FLOAT(double);
+FORMATTER_INPUT_FLOAT(long double);
+
+#undef FORMATTER_INPUT_FLOAT
+
 // NOLINT to suppress missing parentheses warning about __type__.
 #define FORMATTER_INPUT_CHAR(__type__)                          \
     Formatter& Formatter::operator<<(__type__ c) { /* NOLINT */ \
-        return (*this) << std::string(1, (char)c);              \
+        const char ch = static_cast<char>(c);                   \
+        print(&ch, 1);                                          \
+        return *this;                                           \
     }
 
 FORMATTER_INPUT_CHAR(char);
@@ -188,13 +279,13 @@ void Formatter::setNamespace(const std::string &space) {
 }
 
 bool Formatter::isValid() const {
-    return mFile != nullptr;
+    return mFile != nullptr || !mPath.empty();
 }
 
-void Formatter::output(const std::string &text) const {
+void Formatter::output(const char* data, size_t size) {
     CHECK(isValid());
 
-    fprintf(mFile, "%s", text.c_str());
+    mBuffer.append(data, size);
 }
 
 }  // namespace android
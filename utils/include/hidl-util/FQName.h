@@ -101,7 +101,7 @@ struct FQName {
     // Interface names start with 'I'
     bool isInterfaceName() const;
 
-    std::string string() const;
+    const std::string& string() const;
 
     bool operator<(const FQName &other) const;
     bool operator==(const FQName &other) const;
@@ -236,7 +236,12 @@ struct FQName {
     std::string mName;
     std::string mValueName;
 
+    // The result of string(), kept up to date by everything which changes the fields above, so
+    // that comparisons and lookups in ordered containers don't have to build it.
+    std::string mString;
+
     void clear();
+    void updateString();
 
     __attribute__((warn_unused_result)) bool setVersion(const std::string& v);
     __attribute__((warn_unused_result)) bool parseVersion(const std::string& majorStr,
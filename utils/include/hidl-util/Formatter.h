@@ -23,6 +23,8 @@
 
 namespace android {
 
+// Output is collected in memory and written out all at once by close().
+//
 // Two styles to use a Formatter.
 // One is with .indent() calls and operator<<.
 //     out << "if (good) {\n"; out.indent(); out << "blah\nblah\n"; out.unindent(); out << "}\n";
@@ -33,9 +35,17 @@ struct Formatter {
 
     // Assumes ownership of file. Directed to stdout if file == NULL.
     Formatter(FILE* file, size_t spacesPerIndent = 4);
-    Formatter(Formatter&&) = default;
+    // Writes to the file at path, unless it already has the same contents. This keeps the
+    // modification time of unchanged files, so that what depends on them isn't rebuilt.
+    Formatter(const std::string& path, size_t spacesPerIndent = 4);
+    Formatter(Formatter&& other);
+    // Calls close().
     ~Formatter();
 
+    // Writes everything output so far and closes the file. Returns false if writing failed.
+    // Nothing may be output afterwards.
+    bool close();
+
     void indent(size_t level = 1);
     void unindent(size_t level = 1);
 
@@ -145,7 +155,9 @@ struct Formatter {
     // Creates an invalid formatter object.
     Formatter();
 
-    FILE* mFile;  // invalid if nullptr
+    FILE* mFile;  // invalid if nullptr and mPath is empty
+    std::string mPath;  // used instead of mFile if set
+    std::string mBuffer;
     size_t mIndentDepth;
     size_t mSpacesPerIndent;
     bool mAtStartOfLine;
@@ -153,7 +165,10 @@ struct Formatter {
     std::string mSpace;
     std::string mLinePrefix;
 
-    void output(const std::string &text) const;
+    // Appends size bytes at data, indenting each line
+    void print(const char* data, size_t size);
+    void startLine();
+    void output(const char* data, size_t size);
 
     Formatter(const Formatter&) = delete;
     void operator=(const Formatter&) = delete;